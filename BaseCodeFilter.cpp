@@ -0,0 +1,111 @@
+#include "BaseCodeFilter.h"
+#include "Preprocessor.h"
+#include "SourceFile.h"
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <string>
+
+BaseCodeFilter::BaseCodeFilter(const Options &options)
+    : m_options(options)
+{
+}
+
+bool BaseCodeFilter::addFile(const QString &localPath)
+{
+    m_error.clear();
+
+    SourceFile source;
+    if (!source.open(localPath)) {
+        m_error = tr("Failed to open base file: %1").arg(localPath);
+        return false;
+    }
+
+    // Without a window every k-gram hash is selected
+    const RabinKarp rk(0);
+    RabinKarp::FileFingerprints fingerprints;
+    try {
+        Preprocessor preprocessor;
+        if (m_options.tokenMode) {
+            fingerprints = rk.fingerprint(preprocessor.tokenize(source.text()), m_options.k);
+        } else {
+            std::string processed;
+            preprocessor.preprocess(source.text(), processed);
+            fingerprints = rk.fingerprint(processed, m_options.k);
+        }
+    } catch (const std::exception &e) {
+        m_error = tr("Preprocessing error for %1: %2").arg(localPath, e.what());
+        return false;
+    }
+
+    std::vector<long long> merged;
+    merged.reserve(m_hashes.size() + fingerprints.uniqueHashes.size());
+    std::set_union(m_hashes.begin(), m_hashes.end(), fingerprints.uniqueHashes.begin(),
+                   fingerprints.uniqueHashes.end(), std::back_inserter(merged));
+    m_hashes = std::move(merged);
+    return true;
+}
+
+void BaseCodeFilter::clear()
+{
+    m_hashes.clear();
+    m_error.clear();
+}
+
+bool BaseCodeFilter::isEmpty() const
+{
+    return m_hashes.empty();
+}
+
+size_t BaseCodeFilter::size() const
+{
+    return m_hashes.size();
+}
+
+bool BaseCodeFilter::contains(long long hash) const
+{
+    return std::binary_search(m_hashes.begin(), m_hashes.end(), hash);
+}
+
+size_t BaseCodeFilter::apply(RabinKarp::FileFingerprints &fingerprints) const
+{
+    if (m_hashes.empty()) {
+        return 0;
+    }
+
+    auto &selected = fingerprints.fingerprints;
+    const size_t before = selected.size();
+    selected.erase(std::remove_if(selected.begin(), selected.end(),
+                                  [this](const RabinKarp::Fingerprint &fp) { return contains(fp.hash); }),
+                   selected.end());
+
+    // Both sets are sorted, so the base cursor only moves forward
+    auto &unique = fingerprints.uniqueHashes;
+    auto base = m_hashes.begin();
+    auto out = unique.begin();
+    for (long long hash : unique) {
+        base = std::lower_bound(base, m_hashes.end(), hash);
+        if (base == m_hashes.end() || *base != hash) {
+            *out++ = hash;
+        }
+    }
+    unique.erase(out, unique.end());
+
+    return before - selected.size();
+}
+
+QString BaseCodeFilter::errorString() const
+{
+    return m_error;
+}
+
+bool BaseCodeFilter::operator==(const BaseCodeFilter &other) const
+{
+    return m_options.k == other.m_options.k && m_options.tokenMode == other.m_options.tokenMode &&
+           m_hashes == other.m_hashes;
+}
+
+bool BaseCodeFilter::operator!=(const BaseCodeFilter &other) const
+{
+    return !(*this == other);
+}
@@ -0,0 +1,56 @@
+#ifndef BASE_CODE_FILTER_H
+#define BASE_CODE_FILTER_H
+
+#include <QCoreApplication>
+#include <QString>
+#include "Rabin_karp.h"
+#include <cstddef>
+#include <vector>
+
+// Fingerprints of starter code that every submission was handed, removed
+// from each file before it is compared. Matches in that code say nothing
+// about copying; left in, they raise every score and fill the match lists.
+//
+// Every k-gram hash of the base files is kept, not only the winnowed ones,
+// so a submission's own winnowing does not have to select the same hashes.
+// They are held as one sorted array: a lookup is a binary search and a
+// file's sorted unique hashes are filtered in one merge.
+class BaseCodeFilter {
+    Q_DECLARE_TR_FUNCTIONS(BaseCodeFilter)
+
+public:
+    struct Options {
+        int k = 5;               // must match the compared files
+        bool tokenMode = false;
+    };
+
+    explicit BaseCodeFilter(const Options &options = Options());
+
+    // Preprocesses a base file like the compared files and adds its
+    // hashes. Returns false when it cannot be read; errorString() then
+    // describes why.
+    bool addFile(const QString &localPath);
+    void clear();
+
+    bool isEmpty() const;
+    size_t size() const;
+    bool contains(long long hash) const;
+
+    // Drops the base hashes from fingerprints and uniqueHashes. textLength
+    // is kept, so the remaining positions still refer to the same text.
+    // Returns the number of fingerprints removed.
+    size_t apply(RabinKarp::FileFingerprints &fingerprints) const;
+
+    QString errorString() const;
+
+    // Same options and hashes; files filtered by one are valid for the other
+    bool operator==(const BaseCodeFilter &other) const;
+    bool operator!=(const BaseCodeFilter &other) const;
+
+private:
+    Options m_options;
+    std::vector<long long> m_hashes;  // sorted, without duplicates
+    QString m_error;
+};
+
+#endif // BASE_CODE_FILTER_H
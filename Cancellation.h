@@ -0,0 +1,39 @@
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <stdexcept>
+
+// Thrown at a checkpoint of a job whose token has been cancelled
+class OperationCancelled : public std::runtime_error {
+public:
+    OperationCancelled() : std::runtime_error("operation cancelled") {}
+};
+
+// Cooperative cancellation: whoever owns a job calls cancel() from any
+// thread, and the job polls the token at its checkpoints and unwinds with
+// OperationCancelled. Polling is a relaxed atomic load, cheap enough to do
+// once per file or per pair.
+class CancellationToken {
+public:
+    void cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+    bool isCancelled() const { return m_cancelled.load(std::memory_order_relaxed); }
+
+    void throwIfCancelled() const
+    {
+        if (isCancelled()) {
+            throw OperationCancelled();
+        }
+    }
+
+private:
+    std::atomic<bool> m_cancelled{false};
+};
+
+// Receives the units of work finished so far and the total; may be called
+// from several worker threads at once, so it must be thread-safe
+using ProgressCallback = std::function<void(size_t done, size_t total)>;
+
+#endif // CANCELLATION_H
@@ -0,0 +1,569 @@
+#include "ComparisonEngine.h"
+#include "FingerprintIndex.h"
+#include "Profiler.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+
+namespace {
+// A pair of a query that reached the bar, before its matches are extracted
+struct ScoredPair {
+    size_t file1;
+    size_t file2;
+    size_t shared;
+    double similarity;
+};
+
+bool betterPair(const ScoredPair &a, const ScoredPair &b)
+{
+    if (a.similarity != b.similarity) return a.similarity > b.similarity;
+    return a.file1 != b.file1 ? a.file1 < b.file1 : a.file2 < b.file2;
+}
+
+// k-gram matches whose texts differ although their hashes agree
+template <typename Sequence>
+size_t hashCollisions(const Sequence &a, const Sequence &b, const std::vector<std::pair<size_t, size_t>> &matches,
+                      size_t k)
+{
+    size_t count = 0;
+    for (const auto &[start1, start2] : matches) {
+        count += start1 + k > a.size() || start2 + k > b.size() ||
+                 !std::equal(a.begin() + start1, a.begin() + start1 + k, b.begin() + start2);
+    }
+    return count;
+}
+}
+
+ComparisonEngine::ComparisonEngine(const RabinKarp &rabinKarp, const Options &options)
+    : m_rabinKarp(rabinKarp), m_options(options)
+{
+    if (m_options.k <= 0) {
+        throw std::invalid_argument("k-gram size must be positive");
+    }
+    if (m_options.tileSize == 0) {
+        m_options.tileSize = 1;
+    }
+}
+
+ComparisonEngine::~ComparisonEngine() = default;
+
+void ComparisonEngine::setCancellationToken(const CancellationToken *token)
+{
+    m_cancellation = token;
+}
+
+void ComparisonEngine::setProgressCallback(ProgressCallback callback)
+{
+    m_progress = std::move(callback);
+}
+
+void ComparisonEngine::checkCancelled() const
+{
+    if (m_cancellation) {
+        m_cancellation->throwIfCancelled();
+    }
+}
+
+void ComparisonEngine::pairsFinished(std::atomic<size_t> &done, size_t count, size_t total) const
+{
+    const size_t finished = done += count;
+    if (m_progress) {
+        m_progress(finished, total);
+    }
+}
+
+std::vector<ComparisonEngine::PairResult> ComparisonEngine::compareAll(const std::vector<Document> &documents) const
+{
+    const size_t n = documents.size();
+    std::vector<PairResult> results;
+    if (n < 2) {
+        return results;
+    }
+    checkCancelled();
+    Profiler::Scope scope(Profiler::Compare);
+    if (m_options.candidateFilter) {
+        return compareCandidates(documents);
+    }
+
+    // Scores for every pair in one pass over the shared postings
+    FingerprintIndex index;
+    for (const auto &doc : documents) {
+        index.addFile(doc.fingerprints->fingerprints);
+    }
+    const auto scores = index.computeAllPairs();
+
+    results.resize(scores.size());
+    auto pairIndex = [n](size_t a, size_t b) {
+        return a * n - a * (a + 1) / 2 + (b - a - 1);
+    };
+
+    WorkStealingPool pool(m_options.threads);
+    const size_t tile = m_options.tileSize;
+    std::atomic<size_t> done{0};
+
+    // Upper-triangular tiles of the pair matrix, including the diagonal ones
+    for (size_t rowStart = 0; rowStart < n; rowStart += tile) {
+        for (size_t colStart = rowStart; colStart < n; colStart += tile) {
+            pool.submit([&, rowStart, colStart]() {
+                const size_t rowEnd = std::min(rowStart + tile, n);
+                const size_t colEnd = std::min(colStart + tile, n);
+
+                size_t compared = 0;
+                for (size_t i = rowStart; i < rowEnd; ++i) {
+                    for (size_t j = std::max(colStart, i + 1); j < colEnd; ++j) {
+                        checkCancelled();
+                        const size_t slot = pairIndex(i, j);
+                        comparePair(documents[i], documents[j], scores[slot].shared,
+                                    scores[slot].similarity, results[slot], !m_options.scoresOnly);
+                        results[slot].file1 = i;
+                        results[slot].file2 = j;
+                        ++compared;
+                    }
+                }
+                pairsFinished(done, compared, results.size());
+            });
+        }
+    }
+    pool.wait();
+
+    return results;
+}
+
+std::vector<ComparisonEngine::PairResult> ComparisonEngine::addDocument(size_t id, const Document &document)
+{
+    Profiler::Scope scope(Profiler::Compare);
+    if (!m_streamIndex) {
+        m_streamIndex = std::make_unique<FingerprintIndex>();
+        m_streamPool = std::make_unique<WorkStealingPool>(m_options.threads);
+    }
+
+    const size_t file = m_streamIndex->addFile(document.fingerprints->fingerprints);
+    m_streamed.emplace_back(id, document);
+    const auto scores = m_streamIndex->scoreFile(file, document.fingerprints->uniqueHashes);
+
+    std::vector<PairResult> results(scores.size());
+    std::atomic<size_t> done{0};
+    const size_t chunk = m_options.tileSize * m_options.tileSize;
+    for (size_t start = 0; start < scores.size(); start += chunk) {
+        m_streamPool->submit([&, start]() {
+            const size_t end = std::min(start + chunk, scores.size());
+            for (size_t i = start; i < end; ++i) {
+                checkCancelled();
+
+                // Keep the lower id first, as compareAll() does
+                const auto &earlier = m_streamed[i];
+                const bool earlierFirst = earlier.first < id;
+                const Document &doc1 = earlierFirst ? earlier.second : document;
+                const Document &doc2 = earlierFirst ? document : earlier.second;
+
+                comparePair(doc1, doc2, scores[i].shared, scores[i].similarity, results[i], !m_options.scoresOnly);
+                results[i].file1 = std::min(earlier.first, id);
+                results[i].file2 = std::max(earlier.first, id);
+            }
+            pairsFinished(done, end - start, results.size());
+        });
+    }
+    m_streamPool->wait();
+
+    return results;
+}
+
+std::vector<ComparisonEngine::PairResult> ComparisonEngine::compareCandidates(const std::vector<Document> &documents) const
+{
+    WorkStealingPool pool(m_options.threads);
+    const auto candidates = candidatePairs(documents, pool);
+    std::vector<PairResult> results(candidates.size());
+    std::atomic<size_t> done{0};
+
+    // Candidates arrive in row order, so a chunk of consecutive pairs keeps
+    // reusing the same first file, like a tile row does
+    const size_t chunk = m_options.tileSize * m_options.tileSize;
+    for (size_t start = 0; start < candidates.size(); start += chunk) {
+        pool.submit([&, start]() {
+            const size_t end = std::min(start + chunk, candidates.size());
+            for (size_t slot = start; slot < end; ++slot) {
+                checkCancelled();
+                const auto &doc1 = documents[candidates[slot].first];
+                const auto &doc2 = documents[candidates[slot].second];
+                size_t shared;
+                const double similarity = jaccard(doc1, doc2, shared);
+                comparePair(doc1, doc2, shared, similarity, results[slot], !m_options.scoresOnly);
+                results[slot].file1 = candidates[slot].first;
+                results[slot].file2 = candidates[slot].second;
+            }
+            pairsFinished(done, end - start, results.size());
+        });
+    }
+    pool.wait();
+
+    return results;
+}
+
+std::vector<std::pair<size_t, size_t>> ComparisonEngine::candidatePairs(const std::vector<Document> &documents,
+                                                                       WorkStealingPool &pool) const
+{
+    const size_t n = documents.size();
+    const MinHash minHash(m_options.minHash);
+
+    std::vector<MinHash::Sketch> sketches(n);
+    for (size_t i = 0; i < n; ++i) {
+        pool.submit([&, i]() {
+            checkCancelled();
+            sketches[i] = minHash.sketch(documents[i].fingerprints->uniqueHashes);
+        });
+    }
+    pool.wait();
+
+    return minHash.candidatePairs(sketches);
+}
+
+std::vector<ComparisonEngine::PairResult> ComparisonEngine::query(const std::vector<Document> &documents,
+                                                                  const Query &query) const
+{
+    const size_t n = documents.size();
+    std::vector<PairResult> results;
+    if (n < 2) {
+        return results;
+    }
+    checkCancelled();
+    Profiler::Scope scope(Profiler::Compare);
+
+    WorkStealingPool pool(m_options.threads);
+    const size_t k = static_cast<size_t>(m_options.k);
+
+    // Lowest similarity a pair still needs. With topK it rises to the K-th
+    // best score so far; pairs equal to the bar are kept, so no pair of the
+    // final top K is pruned, whatever order the threads find them in.
+    std::atomic<double> bar{query.minSimilarity};
+    std::mutex foundMutex;
+    std::vector<ScoredPair> found;
+    std::vector<PairResult> failed;
+    std::priority_queue<double, std::vector<double>, std::greater<double>> best;
+
+    auto keep = [&](const ScoredPair &pair) {
+        std::lock_guard<std::mutex> lock(foundMutex);
+        found.push_back(pair);
+        if (query.topK == 0) return;
+        best.push(pair.similarity);
+        if (best.size() > query.topK) {
+            best.pop();
+        }
+        if (best.size() == query.topK && best.top() > bar) {
+            bar = best.top();
+        }
+    };
+
+    auto score = [&](size_t i, size_t j) {
+        const Document &doc1 = documents[i];
+        const Document &doc2 = documents[j];
+        const double floor = bar;
+
+        // Inputs shorter than one k-gram have no fingerprints to bound
+        if (doc1.fingerprints->textLength < k || doc2.fingerprints->textLength < k) {
+            PairResult result;
+            size_t shared;
+            const double similarity = jaccard(doc1, doc2, shared);
+            comparePair(doc1, doc2, shared, similarity, result, false);
+            if (!result.compared) {
+                result.file1 = i;
+                result.file2 = j;
+                std::lock_guard<std::mutex> lock(foundMutex);
+                failed.push_back(std::move(result));
+            } else if (result.similarity >= floor) {
+                keep({i, j, shared, result.similarity});
+            }
+            return;
+        }
+
+        const auto &set1 = doc1.fingerprints->uniqueHashes;
+        const auto &set2 = doc2.fingerprints->uniqueHashes;
+        const size_t smaller = std::min(set1.size(), set2.size());
+        const size_t larger = std::max(set1.size(), set2.size());
+        if (larger == 0) {
+            // Both lost every fingerprint to base code filtering
+            if (floor <= 0.0) keep({i, j, 0, 0.0});
+            return;
+        }
+        // |A & B| / |A | B| <= min(|A|, |B|) / max(|A|, |B|)
+        if (static_cast<double>(smaller) / larger < floor) {
+            Profiler::add(Profiler::PairsPruned);
+            return;
+        }
+        // A similarity of floor needs floor * (|A| + |B|) / (1 + floor)
+        // shared values; rounding down keeps the cut-off on the safe side
+        const size_t minimum = static_cast<size_t>(floor * (set1.size() + set2.size()) / (1.0 + floor));
+        const size_t shared = RabinKarp::intersectionSize(set1, set2, minimum);
+        if (shared < minimum) {
+            Profiler::add(Profiler::PairsPruned);
+            return;
+        }
+        const double similarity = static_cast<double>(shared) / (set1.size() + set2.size() - shared);
+        if (similarity >= floor) {
+            keep({i, j, shared, similarity});
+        }
+    };
+
+    const size_t totalPairs = n * (n - 1) / 2;
+    std::atomic<size_t> done{0};
+    const size_t chunk = m_options.tileSize * m_options.tileSize;
+    std::vector<std::pair<size_t, size_t>> candidates;
+    std::vector<size_t> order;
+    std::vector<size_t> shortDocuments;
+    if (m_options.candidateFilter) {
+        candidates = candidatePairs(documents, pool);
+        for (size_t start = 0; start < candidates.size(); start += chunk) {
+            pool.submit([&, start]() {
+                const size_t end = std::min(start + chunk, candidates.size());
+                for (size_t slot = start; slot < end; ++slot) {
+                    checkCancelled();
+                    score(candidates[slot].first, candidates[slot].second);
+                }
+                pairsFinished(done, end - start, candidates.size());
+            });
+        }
+    } else {
+        // Documents by set size: along a row the size bound only falls, so
+        // the row ends at the first pair that fails it
+        for (size_t i = 0; i < n; ++i) {
+            (documents[i].fingerprints->textLength < k ? shortDocuments : order).push_back(i);
+        }
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+            return documents[a].fingerprints->uniqueHashes.size() < documents[b].fingerprints->uniqueHashes.size();
+        });
+
+        for (size_t row = 0; row < order.size(); ++row) {
+            pool.submit([&, row]() {
+                const size_t i = order[row];
+                const double size1 = static_cast<double>(documents[i].fingerprints->uniqueHashes.size());
+                for (size_t column = row + 1; column < order.size(); ++column) {
+                    checkCancelled();
+                    const size_t j = order[column];
+                    const size_t size2 = documents[j].fingerprints->uniqueHashes.size();
+                    if (size2 > 0 && size1 / size2 < bar) {
+                        Profiler::add(Profiler::PairsPruned, order.size() - column);
+                        break;
+                    }
+                    score(std::min(i, j), std::max(i, j));
+                }
+                pairsFinished(done, order.size() - row - 1, totalPairs);
+            });
+        }
+        // Short documents pair with everything else, each pair once
+        for (size_t s = 0; s < shortDocuments.size(); ++s) {
+            pool.submit([&, s]() {
+                const size_t i = shortDocuments[s];
+                size_t compared = 0;
+                for (size_t j = 0; j < n; ++j) {
+                    const bool isShort = documents[j].fingerprints->textLength < k;
+                    if (j == i || (isShort && j < i)) continue;
+                    checkCancelled();
+                    score(std::min(i, j), std::max(i, j));
+                    ++compared;
+                }
+                pairsFinished(done, compared, totalPairs);
+            });
+        }
+    }
+    pool.wait();
+
+    // Threads may have kept pairs before the bar rose past them
+    std::sort(found.begin(), found.end(), betterPair);
+    const double finalBar = bar;
+    found.erase(std::find_if(found.begin(), found.end(),
+                             [finalBar](const ScoredPair &pair) { return pair.similarity < finalBar; }),
+                found.end());
+    if (query.topK > 0 && found.size() > query.topK) {
+        found.resize(query.topK);
+    }
+
+    results.resize(found.size());
+    for (size_t start = 0; start < found.size(); start += chunk) {
+        pool.submit([&, start]() {
+            const size_t end = std::min(start + chunk, found.size());
+            for (size_t slot = start; slot < end; ++slot) {
+                checkCancelled();
+                const ScoredPair &pair = found[slot];
+                comparePair(documents[pair.file1], documents[pair.file2], pair.shared, pair.similarity,
+                            results[slot], !m_options.scoresOnly);
+                results[slot].file1 = pair.file1;
+                results[slot].file2 = pair.file2;
+            }
+        });
+    }
+    pool.wait();
+
+    std::sort(failed.begin(), failed.end(), [](const PairResult &a, const PairResult &b) {
+        return a.file1 != b.file1 ? a.file1 < b.file1 : a.file2 < b.file2;
+    });
+    std::move(failed.begin(), failed.end(), std::back_inserter(results));
+    return results;
+}
+
+std::vector<ComparisonEngine::PairResult> ComparisonEngine::compareChanged(const std::vector<Document> &documents,
+                                                                          const std::vector<size_t> &changed) const
+{
+    const size_t n = documents.size();
+    std::vector<bool> isChanged(n, false);
+    for (size_t id : changed) {
+        if (id < n) isChanged[id] = true;
+    }
+    std::vector<size_t> changedIds;
+    for (size_t id = 0; id < n; ++id) {
+        if (isChanged[id]) changedIds.push_back(id);
+    }
+
+    // A changed row pairs with every later file, any other row only with
+    // the later changed ones
+    std::vector<PairResult> results;
+    for (size_t i = 0; i < n; ++i) {
+        if (isChanged[i]) {
+            for (size_t j = i + 1; j < n; ++j) {
+                results.emplace_back();
+                results.back().file1 = i;
+                results.back().file2 = j;
+            }
+        } else {
+            for (auto it = std::upper_bound(changedIds.begin(), changedIds.end(), i); it != changedIds.end(); ++it) {
+                results.emplace_back();
+                results.back().file1 = i;
+                results.back().file2 = *it;
+            }
+        }
+    }
+    if (results.empty()) {
+        return results;
+    }
+    checkCancelled();
+    Profiler::Scope scope(Profiler::Compare);
+
+    WorkStealingPool pool(m_options.threads);
+    std::atomic<size_t> done{0};
+    const size_t chunk = m_options.tileSize * m_options.tileSize;
+    for (size_t start = 0; start < results.size(); start += chunk) {
+        pool.submit([&, start]() {
+            const size_t end = std::min(start + chunk, results.size());
+            for (size_t i = start; i < end; ++i) {
+                checkCancelled();
+                auto &result = results[i];
+                const auto &doc1 = documents[result.file1];
+                const auto &doc2 = documents[result.file2];
+                size_t shared;
+                const double similarity = jaccard(doc1, doc2, shared);
+                comparePair(doc1, doc2, shared, similarity, result, !m_options.scoresOnly);
+            }
+            pairsFinished(done, end - start, results.size());
+        });
+    }
+    pool.wait();
+
+    return results;
+}
+
+ComparisonEngine::PairResult ComparisonEngine::compare(const Document &doc1, const Document &doc2) const
+{
+    PairResult result;
+    size_t shared;
+    const double similarity = jaccard(doc1, doc2, shared);
+    comparePair(doc1, doc2, shared, similarity, result, true);
+    return result;
+}
+
+double ComparisonEngine::jaccard(const Document &doc1, const Document &doc2, size_t &shared)
+{
+    const auto &set1 = doc1.fingerprints->uniqueHashes;
+    const auto &set2 = doc2.fingerprints->uniqueHashes;
+
+    shared = RabinKarp::intersectionSize(set1, set2);
+    if (set1.empty() && set2.empty()) return 1.0;
+    if (set1.empty() || set2.empty()) return 0.0;
+    return static_cast<double>(shared) / (set1.size() + set2.size() - shared);
+}
+
+void ComparisonEngine::comparePair(const Document &doc1, const Document &doc2, size_t shared,
+                                   double indexedSimilarity, PairResult &result, bool withMatches) const
+{
+    const auto &fp1 = *doc1.fingerprints;
+    const auto &fp2 = *doc2.fingerprints;
+
+    if (fp1.textLength == 0 || fp2.textLength == 0) {
+        result.error = "empty processed content";
+        return;
+    }
+
+    try {
+        const size_t shortest = std::min(fp1.textLength, fp2.textLength);
+
+        if (shortest < static_cast<size_t>(m_options.k)) {
+            // Inputs shorter than one k-gram have no fingerprints; compare
+            // them with k shrunk to the shorter input instead
+            const int k = static_cast<int>(shortest);
+            RabinKarp::FileFingerprints short1;
+            RabinKarp::FileFingerprints short2;
+            if (doc1.tokens && doc2.tokens) {
+                short1 = m_rabinKarp.fingerprint(*doc1.tokens, k);
+                short2 = m_rabinKarp.fingerprint(*doc2.tokens, k);
+            } else {
+                short1 = m_rabinKarp.fingerprint(std::string(doc1.text), k);
+                short2 = m_rabinKarp.fingerprint(std::string(doc2.text), k);
+            }
+            result.similarity = m_rabinKarp.computeSimilarity(short1, short2);
+            if (withMatches) {
+                collectMatches(doc1, doc2, short1, short2, result);
+            }
+        } else if (fp1.uniqueHashes.empty() && fp2.uniqueHashes.empty()) {
+            // Long enough texts only lose all their fingerprints to base
+            // code filtering; nothing of their own is shared then
+            result.similarity = 0.0;
+        } else {
+            result.similarity = indexedSimilarity;
+            // Pairs without a shared fingerprint cannot have matches
+            if (withMatches && shared > 0) {
+                collectMatches(doc1, doc2, fp1, fp2, result);
+            }
+        }
+        result.compared = true;
+        Profiler::add(Profiler::PairsScored);
+    } catch (const std::exception &e) {
+        result.error = e.what();
+    }
+}
+
+void ComparisonEngine::collectMatches(const Document &doc1, const Document &doc2,
+                                      const RabinKarp::FileFingerprints &fp1, const RabinKarp::FileFingerprints &fp2,
+                                      PairResult &result) const
+{
+    Profiler::Scope scope(Profiler::MatchExtraction);
+    if (!m_options.matchRuns) {
+        result.matches = m_rabinKarp.findMatches(fp1, fp2);
+        Profiler::add(Profiler::MatchRuns, result.matches.size());
+        countCollisions(doc1, doc2, static_cast<size_t>(fp1.k), result.matches);
+        return;
+    }
+
+    // Runs are extended over the texts the fingerprints were built from,
+    // which also drops hash collisions; without them only the hits count
+    const size_t minRun = m_options.minRunLength;
+    const size_t maxPostings = m_options.maxPostings;
+    if (doc1.tokens && doc2.tokens) {
+        result.runs = m_rabinKarp.findMatchRuns(fp1, fp2, *doc1.tokens, *doc2.tokens, minRun, maxPostings);
+    } else if (doc1.text.size() == fp1.textLength && doc2.text.size() == fp2.textLength) {
+        result.runs = m_rabinKarp.findMatchRuns(fp1, fp2, doc1.text, doc2.text, minRun, maxPostings);
+    } else {
+        result.runs = m_rabinKarp.findMatchRuns(fp1, fp2, minRun, maxPostings);
+    }
+    Profiler::add(Profiler::MatchRuns, result.runs.size());
+}
+
+void ComparisonEngine::countCollisions(const Document &doc1, const Document &doc2, size_t k,
+                                       const std::vector<std::pair<size_t, size_t>> &matches)
+{
+    // Touches the text of every match, so only while profiling
+    if (!Profiler::isEnabled() || k == 0) return;
+    const size_t collisions = doc1.tokens && doc2.tokens ? hashCollisions(*doc1.tokens, *doc2.tokens, matches, k)
+                                                         : hashCollisions(doc1.text, doc2.text, matches, k);
+    Profiler::add(Profiler::HashCollisions, collisions);
+}
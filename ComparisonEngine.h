@@ -0,0 +1,142 @@
+#ifndef COMPARISON_ENGINE_H
+#define COMPARISON_ENGINE_H
+
+#include "Cancellation.h"
+#include "MinHash.h"
+#include "Rabin_karp.h"
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class FingerprintIndex;
+class WorkStealingPool;
+
+// All-pairs comparison driver. Pair scores come from a FingerprintIndex
+// pass; the per-pair match extraction is split into square tiles of the
+// pair matrix that run on a work-stealing thread pool. Every pair writes to
+// its own result slot, so the output order and scores do not depend on the
+// number of threads.
+//
+// With the candidate filter enabled, only pairs proposed by MinHash/LSH are
+// scored exactly, which avoids the quadratic pair matrix on large corpora.
+class ComparisonEngine {
+public:
+    struct Options {
+        int k = 5;
+        size_t threads = 0;   // 0 uses the hardware concurrency
+        size_t tileSize = 8;  // files per side of one pair-matrix tile
+
+        // Report maximal match runs instead of every matching k-gram pair
+        bool matchRuns = false;
+        size_t minRunLength = 0;
+        size_t maxPostings = 64;
+
+        // Only score the pairs; matches and runs are left empty and can be
+        // computed later for the pairs that need them with compare()
+        bool scoresOnly = false;
+
+        // Score only the pairs proposed by MinHash/LSH banding
+        bool candidateFilter = false;
+        MinHash::Options minHash;
+    };
+
+    struct Document {
+        std::string_view text;  // preprocessed text
+        const RabinKarp::FileFingerprints *fingerprints = nullptr;
+        // Set when the fingerprints were built from a token stream
+        const std::vector<uint32_t> *tokens = nullptr;
+    };
+
+    // Which pairs query() reports
+    struct Query {
+        double minSimilarity = 0.0;  // 0..1
+        size_t topK = 0;             // only the best topK pairs; 0 keeps all
+    };
+
+    struct PairResult {
+        size_t file1 = 0;
+        size_t file2 = 0;
+        bool compared = false;
+        double similarity = 0.0;
+        std::vector<std::pair<size_t, size_t>> matches;  // k-gram pairs mode
+        std::vector<RabinKarp::MatchRun> runs;           // match runs mode
+        std::string error;
+    };
+
+    ComparisonEngine(const RabinKarp &rabinKarp, const Options &options);
+    ~ComparisonEngine();
+
+    ComparisonEngine(const ComparisonEngine &) = delete;
+    ComparisonEngine &operator=(const ComparisonEngine &) = delete;
+
+    // Results for every pair file1 < file2, or for every candidate pair
+    // when the candidate filter is on, ordered by file1 then file2
+    std::vector<PairResult> compareAll(const std::vector<Document> &documents) const;
+
+    // Streaming alternative to compareAll() for documents that become ready
+    // one at a time: each added document is compared with every document
+    // added before it. id is the caller's number for the document and ends
+    // up in file1/file2, with file1 < file2. Documents must stay alive as
+    // long as the engine. The candidate filter does not apply here.
+    std::vector<PairResult> addDocument(size_t id, const Document &document);
+
+    // Pairs in which at least one document is listed in changed, each once
+    // and ordered by file1 then file2, for rescoring files that changed on
+    // disk. Every such pair is scored exactly; the candidate filter does
+    // not apply here.
+    std::vector<PairResult> compareChanged(const std::vector<Document> &documents,
+                                           const std::vector<size_t> &changed) const;
+
+    // Pairs with a similarity of at least query.minSimilarity, and only the
+    // query.topK best when that is set, best first and ties ordered by file1
+    // then file2; pairs that could not be compared come last. A pair is
+    // dropped without an exact score once the ratio of its fingerprint-set
+    // sizes, an upper bound of the Jaccard similarity, falls below the bar,
+    // or once its intersection can no longer reach it. With topK the bar
+    // rises to the K-th best score found so far. Only reported pairs get
+    // matches or runs. The candidate filter applies as in compareAll().
+    std::vector<PairResult> query(const std::vector<Document> &documents, const Query &query) const;
+
+    // One pair on the calling thread, with matches or runs even when
+    // scoresOnly is set; file1 and file2 are left at 0
+    PairResult compare(const Document &doc1, const Document &doc2) const;
+
+    // Polled before every pair; once it is cancelled, compareAll() and
+    // addDocument() throw OperationCancelled and the engine should not be
+    // used again. The token must outlive the engine.
+    void setCancellationToken(const CancellationToken *token);
+
+    // Called from the worker threads with the pairs finished so far in the
+    // current compareAll() or addDocument() call, about once per tile
+    void setProgressCallback(ProgressCallback callback);
+
+private:
+    std::vector<PairResult> compareCandidates(const std::vector<Document> &documents) const;
+    std::vector<std::pair<size_t, size_t>> candidatePairs(const std::vector<Document> &documents,
+                                                          WorkStealingPool &pool) const;
+    void comparePair(const Document &doc1, const Document &doc2, size_t shared,
+                     double indexedSimilarity, PairResult &result, bool withMatches) const;
+    void collectMatches(const Document &doc1, const Document &doc2, const RabinKarp::FileFingerprints &fp1,
+                        const RabinKarp::FileFingerprints &fp2, PairResult &result) const;
+    static double jaccard(const Document &doc1, const Document &doc2, size_t &shared);
+    static void countCollisions(const Document &doc1, const Document &doc2, size_t k,
+                                const std::vector<std::pair<size_t, size_t>> &matches);
+    void checkCancelled() const;
+    void pairsFinished(std::atomic<size_t> &done, size_t count, size_t total) const;
+
+    RabinKarp m_rabinKarp;
+    Options m_options;
+    const CancellationToken *m_cancellation = nullptr;
+    ProgressCallback m_progress;
+
+    // State of addDocument()
+    std::unique_ptr<FingerprintIndex> m_streamIndex;
+    std::unique_ptr<WorkStealingPool> m_streamPool;
+    std::vector<std::pair<size_t, Document>> m_streamed;
+};
+
+#endif // COMPARISON_ENGINE_H
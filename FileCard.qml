@@ -47,6 +47,15 @@ Rectangle {
                 localFilePath = "file:///" + filePath;
             }
 
+            // Archives are unpacked by the backend when the check runs;
+            // their bytes are no text to preview
+            if (/\.(zip|tar|tar\.gz|tgz)$/i.test(filePath)) {
+                fileContent = "Archive: its source files are compared when the check runs";
+                processedContent = "";
+                isLoading = false;
+                return;
+            }
+
             // Read original content
             fileContent = fileReader.readFile(filePath);
 
@@ -255,6 +264,7 @@ Rectangle {
         fileMode: FileDialog.OpenFile
         nameFilters: [
             "Source files (*.cpp *.h *.py *.java *.js *.txt)",
+            "Archives (*.zip *.tar *.tar.gz *.tgz)",
             "All files (*)"
         ]
         onAccepted: {
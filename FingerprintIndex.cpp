@@ -0,0 +1,136 @@
+#include "FingerprintIndex.h"
+#include "Profiler.h"
+#include <algorithm>
+
+namespace {
+
+double jaccard(size_t common, size_t size1, size_t size2)
+{
+    if (size1 == 0 && size2 == 0) {
+        return 1.0;
+    }
+    if (size1 == 0 || size2 == 0) {
+        return 0.0;
+    }
+    return static_cast<double>(common) / (size1 + size2 - common);
+}
+
+}
+
+size_t FingerprintIndex::addFile(const std::vector<RabinKarp::Fingerprint> &fingerprints)
+{
+    Profiler::Scope scope(Profiler::IndexBuild);
+    const size_t file = m_uniqueCounts.size();
+    size_t unique = 0;
+    size_t longest = 0;
+
+    for (const auto &fp : fingerprints) {
+        auto &list = m_postings[fp.hash];
+        // Postings of one file are appended together, so checking the last
+        // entry is enough to count each hash once per file
+        if (list.empty() || list.back().file != file) {
+            unique++;
+        }
+        list.push_back({file, fp.position});
+        longest = std::max(longest, list.size());
+    }
+
+    m_uniqueCounts.push_back(unique);
+    Profiler::add(Profiler::Postings, fingerprints.size());
+    Profiler::raise(Profiler::LongestPostingList, longest);
+    return file;
+}
+
+void FingerprintIndex::clear()
+{
+    m_postings.clear();
+    m_uniqueCounts.clear();
+}
+
+size_t FingerprintIndex::fileCount() const
+{
+    return m_uniqueCounts.size();
+}
+
+size_t FingerprintIndex::uniqueCount(size_t file) const
+{
+    return m_uniqueCounts.at(file);
+}
+
+const std::vector<FingerprintIndex::Posting> *FingerprintIndex::postings(long long hash) const
+{
+    auto it = m_postings.find(hash);
+    return it != m_postings.end() ? &it->second : nullptr;
+}
+
+std::vector<FingerprintIndex::PairScore> FingerprintIndex::computeAllPairs() const
+{
+    const size_t n = m_uniqueCounts.size();
+    std::vector<PairScore> scores;
+    if (n < 2) {
+        return scores;
+    }
+    Profiler::Scope scope(Profiler::Scoring);
+
+    // Shared fingerprint counts for the upper triangle of the pair matrix
+    auto pairIndex = [n](size_t a, size_t b) {
+        return a * n - a * (a + 1) / 2 + (b - a - 1);
+    };
+    std::vector<size_t> shared(n * (n - 1) / 2, 0);
+
+    std::vector<size_t> files;
+    for (const auto &entry : m_postings) {
+        const auto &list = entry.second;
+        if (list.size() < 2) continue;
+
+        files.clear();
+        for (const auto &posting : list) {
+            if (files.empty() || files.back() != posting.file) {
+                files.push_back(posting.file);
+            }
+        }
+
+        for (size_t a = 0; a < files.size(); ++a) {
+            for (size_t b = a + 1; b < files.size(); ++b) {
+                shared[pairIndex(files[a], files[b])]++;
+            }
+        }
+    }
+
+    scores.reserve(shared.size());
+    for (size_t i = 0; i < n; ++i) {
+        for (size_t j = i + 1; j < n; ++j) {
+            const size_t common = shared[pairIndex(i, j)];
+            scores.push_back({i, j, common, jaccard(common, m_uniqueCounts[i], m_uniqueCounts[j])});
+        }
+    }
+
+    return scores;
+}
+
+std::vector<FingerprintIndex::PairScore> FingerprintIndex::scoreFile(size_t file,
+                                                                      const std::vector<long long> &uniqueHashes) const
+{
+    Profiler::Scope scope(Profiler::Scoring);
+    std::vector<size_t> shared(std::min(file, m_uniqueCounts.size()), 0);
+
+    for (long long hash : uniqueHashes) {
+        const auto *list = postings(hash);
+        if (!list) continue;
+
+        size_t last = file;
+        for (const auto &posting : *list) {
+            if (posting.file < shared.size() && posting.file != last) {
+                shared[posting.file]++;
+                last = posting.file;
+            }
+        }
+    }
+
+    std::vector<PairScore> scores;
+    scores.reserve(shared.size());
+    for (size_t i = 0; i < shared.size(); ++i) {
+        scores.push_back({i, file, shared[i], jaccard(shared[i], m_uniqueCounts[i], m_uniqueCounts.at(file))});
+    }
+    return scores;
+}
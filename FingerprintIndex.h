@@ -0,0 +1,49 @@
+#ifndef FINGERPRINT_INDEX_H
+#define FINGERPRINT_INDEX_H
+
+#include "Rabin_karp.h"
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+
+// Inverted index from fingerprint hash to the files (and positions) that
+// contain it. Pair similarities for a whole corpus are accumulated in a
+// single pass over the posting lists, so the work is proportional to the
+// number of shared fingerprints instead of pairs x file length.
+class FingerprintIndex {
+public:
+    struct Posting {
+        size_t file;
+        size_t position;
+    };
+
+    struct PairScore {
+        size_t file1;
+        size_t file2;
+        size_t shared;
+        double similarity;
+    };
+
+    // Adds a file and returns its id; ids are assigned in insertion order
+    size_t addFile(const std::vector<RabinKarp::Fingerprint> &fingerprints);
+    void clear();
+
+    size_t fileCount() const;
+    size_t uniqueCount(size_t file) const;
+    const std::vector<Posting> *postings(long long hash) const;
+
+    // Jaccard similarity of every file pair (file1 < file2), ordered by
+    // file1 then file2
+    std::vector<PairScore> computeAllPairs() const;
+
+    // Jaccard similarity of file against every file added before it
+    // (file1 < file2 == file), for indexes that grow one file at a time.
+    // uniqueHashes are the file's distinct hashes.
+    std::vector<PairScore> scoreFile(size_t file, const std::vector<long long> &uniqueHashes) const;
+
+private:
+    std::unordered_map<long long, std::vector<Posting>> m_postings;
+    std::vector<size_t> m_uniqueCounts;
+};
+
+#endif // FINGERPRINT_INDEX_H
@@ -0,0 +1,361 @@
+#include "FingerprintStore.h"
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+constexpr char MAGIC[8] = {'H', 'T', 'F', 'P', 'S', 'T', '0', '1'};
+constexpr int KEY_SIZE = 16;
+
+struct Header {
+    char magic[8];
+    uchar config[KEY_SIZE];
+    quint64 entryCount;
+    quint64 indexOffset;
+    quint64 fileSize;
+};
+
+struct IndexEntry {
+    uchar key[KEY_SIZE];
+    quint64 offset;
+    quint64 size;
+};
+
+// Followed by the processed text, the tokens, the fingerprints as
+// (hash, position) pairs and the unique hashes, each padded to 8 bytes
+struct RecordHeader {
+    quint32 k;
+    quint32 reserved;
+    quint64 textLength;
+    quint64 processedSize;
+    quint64 tokenCount;
+    quint64 fingerprintCount;
+    quint64 uniqueCount;
+};
+
+constexpr quint64 padded(quint64 size)
+{
+    return (size + 7) & ~quint64(7);
+}
+
+quint64 recordSize(const RecordHeader &header)
+{
+    return sizeof(RecordHeader) + padded(header.processedSize) +
+           padded(header.tokenCount * sizeof(quint32)) +
+           header.fingerprintCount * 2 * sizeof(quint64) + header.uniqueCount * sizeof(qint64);
+}
+
+QByteArray configKey(const QByteArray &configTag)
+{
+    return QCryptographicHash::hash(configTag, QCryptographicHash::Blake2b_128);
+}
+
+}
+
+FingerprintStore::FingerprintStore(const QString &path, const QByteArray &configTag, qint64 maxBytes)
+    : m_path(path), m_config(configKey(configTag)), m_maxBytes(maxBytes)
+{
+    open();
+}
+
+FingerprintStore::~FingerprintStore()
+{
+    close();
+}
+
+QByteArray FingerprintStore::contentKey(QByteArrayView content, bool tokenMode)
+{
+    QCryptographicHash hash(QCryptographicHash::Blake2b_128);
+    hash.addData(content);
+    hash.addData(tokenMode ? QByteArrayView("t") : QByteArrayView("c"));
+    return hash.result();
+}
+
+void FingerprintStore::open()
+{
+    m_file.setFileName(m_path);
+    if (!m_file.exists() || !m_file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+
+    const qint64 size = m_file.size();
+    if (size < static_cast<qint64>(sizeof(Header))) {
+        m_file.close();
+        return;
+    }
+
+    const uchar *map = m_file.map(0, size);
+    if (!map) {
+        qWarning() << "Could not map fingerprint store:" << m_path;
+        m_file.close();
+        return;
+    }
+
+    Header header;
+    std::memcpy(&header, map, sizeof(header));
+    const bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 &&
+                       static_cast<quint64>(size) == header.fileSize &&
+                       header.indexOffset <= header.fileSize &&
+                       (header.fileSize - header.indexOffset) / sizeof(IndexEntry) == header.entryCount &&
+                       (header.fileSize - header.indexOffset) % sizeof(IndexEntry) == 0;
+    if (!valid) {
+        qWarning() << "Ignoring damaged fingerprint store:" << m_path;
+    }
+
+    // A store from another configuration is simply rebuilt on the next save
+    if (!valid || std::memcmp(header.config, m_config.constData(), KEY_SIZE) != 0) {
+        m_file.unmap(const_cast<uchar *>(map));
+        m_file.close();
+        return;
+    }
+
+    m_map = map;
+    m_mapSize = size;
+    m_entryCount = header.entryCount;
+    m_indexOffset = header.indexOffset;
+}
+
+void FingerprintStore::close()
+{
+    if (m_map) {
+        m_file.unmap(const_cast<uchar *>(m_map));
+    }
+    m_file.close();
+    m_map = nullptr;
+    m_mapSize = 0;
+    m_entryCount = 0;
+    m_indexOffset = 0;
+}
+
+FingerprintStore::Span FingerprintStore::findRecord(const QByteArray &key) const
+{
+    if (!m_map || key.size() != KEY_SIZE) {
+        return {};
+    }
+
+    const uchar *index = m_map + m_indexOffset;
+    quint64 low = 0;
+    quint64 high = m_entryCount;
+    while (low < high) {
+        const quint64 mid = low + (high - low) / 2;
+        IndexEntry entry;
+        std::memcpy(&entry, index + mid * sizeof(IndexEntry), sizeof(entry));
+
+        const int order = std::memcmp(entry.key, key.constData(), KEY_SIZE);
+        if (order < 0) {
+            low = mid + 1;
+        } else if (order > 0) {
+            high = mid;
+        } else {
+            if (entry.offset > m_indexOffset || entry.size > m_indexOffset - entry.offset) {
+                return {};
+            }
+            return {m_map + entry.offset, static_cast<qint64>(entry.size)};
+        }
+    }
+    return {};
+}
+
+bool FingerprintStore::lookup(const QByteArray &key, std::string &processedContent, std::vector<uint32_t> &tokens,
+                              RabinKarp::FileFingerprints &fingerprints)
+{
+    QMutexLocker locker(&m_mutex);
+    const uchar *data;
+    qint64 size;
+    QByteArray pending = m_pending.value(key);
+    Span span = findRecord(key);
+    if (!pending.isEmpty()) {
+        data = reinterpret_cast<const uchar *>(pending.constData());
+        size = pending.size();
+    } else if (span.data) {
+        data = span.data;
+        size = span.size;
+    } else {
+        return false;
+    }
+
+    RecordHeader header;
+    if (size < static_cast<qint64>(sizeof(header))) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.processedSize > static_cast<quint64>(size) || header.tokenCount > static_cast<quint64>(size) ||
+        header.fingerprintCount > static_cast<quint64>(size) || header.uniqueCount > static_cast<quint64>(size) ||
+        recordSize(header) != static_cast<quint64>(size)) {
+        return false;
+    }
+
+    const uchar *p = data + sizeof(header);
+    processedContent.assign(reinterpret_cast<const char *>(p), header.processedSize);
+    p += padded(header.processedSize);
+
+    tokens.resize(header.tokenCount);
+    if (!tokens.empty()) {
+        std::memcpy(tokens.data(), p, header.tokenCount * sizeof(quint32));
+    }
+    p += padded(header.tokenCount * sizeof(quint32));
+
+    fingerprints.k = static_cast<int>(header.k);
+    fingerprints.textLength = header.textLength;
+    fingerprints.fingerprints.resize(header.fingerprintCount);
+    for (auto &fingerprint : fingerprints.fingerprints) {
+        quint64 pair[2];
+        std::memcpy(pair, p, sizeof(pair));
+        fingerprint.hash = static_cast<long long>(pair[0]);
+        fingerprint.position = static_cast<size_t>(pair[1]);
+        p += sizeof(pair);
+    }
+    fingerprints.uniqueHashes.resize(header.uniqueCount);
+    if (!fingerprints.uniqueHashes.empty()) {
+        std::memcpy(fingerprints.uniqueHashes.data(), p, header.uniqueCount * sizeof(qint64));
+    }
+
+    if (span.data) {
+        m_used.insert(key);
+    }
+    return true;
+}
+
+void FingerprintStore::insert(const QByteArray &key, const std::string &processedContent,
+                              const std::vector<uint32_t> &tokens, const RabinKarp::FileFingerprints &fingerprints)
+{
+    if (key.size() != KEY_SIZE) {
+        return;
+    }
+
+    RecordHeader header = {};
+    header.k = static_cast<quint32>(fingerprints.k);
+    header.textLength = fingerprints.textLength;
+    header.processedSize = processedContent.size();
+    header.tokenCount = tokens.size();
+    header.fingerprintCount = fingerprints.fingerprints.size();
+    header.uniqueCount = fingerprints.uniqueHashes.size();
+
+    // Zero-filled, so the padding bytes are deterministic
+    QByteArray record(static_cast<qsizetype>(recordSize(header)), '\0');
+    uchar *p = reinterpret_cast<uchar *>(record.data());
+    std::memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+
+    std::memcpy(p, processedContent.data(), processedContent.size());
+    p += padded(header.processedSize);
+    if (!tokens.empty()) {
+        std::memcpy(p, tokens.data(), tokens.size() * sizeof(quint32));
+    }
+    p += padded(header.tokenCount * sizeof(quint32));
+
+    for (const auto &fingerprint : fingerprints.fingerprints) {
+        const quint64 pair[2] = {static_cast<quint64>(fingerprint.hash), static_cast<quint64>(fingerprint.position)};
+        std::memcpy(p, pair, sizeof(pair));
+        p += sizeof(pair);
+    }
+    if (!fingerprints.uniqueHashes.empty()) {
+        std::memcpy(p, fingerprints.uniqueHashes.data(), fingerprints.uniqueHashes.size() * sizeof(qint64));
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!findRecord(key).data) {
+        m_pending.insert(key, record);
+    }
+}
+
+bool FingerprintStore::save()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_pending.isEmpty()) {
+        return true;
+    }
+
+    struct Record {
+        QByteArray key;
+        const uchar *data;
+        quint64 size;
+    };
+    std::vector<Record> records;
+    quint64 total = sizeof(Header);
+
+    // New and recently used entries always survive; older ones fill the
+    // remaining space in index order
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+        records.push_back({it.key(), reinterpret_cast<const uchar *>(it.value().constData()),
+                           static_cast<quint64>(it.value().size())});
+        total += it.value().size() + sizeof(IndexEntry);
+    }
+
+    std::vector<Record> older;
+    for (quint64 i = 0; i < m_entryCount; ++i) {
+        IndexEntry entry;
+        std::memcpy(&entry, m_map + m_indexOffset + i * sizeof(IndexEntry), sizeof(entry));
+        QByteArray key(reinterpret_cast<const char *>(entry.key), KEY_SIZE);
+        if (entry.offset > m_indexOffset || entry.size > m_indexOffset - entry.offset) {
+            continue;
+        }
+
+        Record record = {key, m_map + entry.offset, entry.size};
+        if (m_used.contains(key)) {
+            records.push_back(record);
+            total += entry.size + sizeof(IndexEntry);
+        } else {
+            older.push_back(record);
+        }
+    }
+    for (const auto &record : older) {
+        if (total + record.size + sizeof(IndexEntry) > static_cast<quint64>(m_maxBytes)) {
+            break;
+        }
+        records.push_back(record);
+        total += record.size + sizeof(IndexEntry);
+    }
+
+    QDir().mkpath(QFileInfo(m_path).absolutePath());
+    QSaveFile out(m_path);
+    if (!out.open(QIODevice::WriteOnly)) {
+        qWarning() << "Could not write fingerprint store:" << m_path;
+        return false;
+    }
+
+    std::vector<IndexEntry> index(records.size());
+    quint64 offset = sizeof(Header);
+    for (size_t i = 0; i < records.size(); ++i) {
+        std::memcpy(index[i].key, records[i].key.constData(), KEY_SIZE);
+        index[i].offset = offset;
+        index[i].size = records[i].size;
+        offset += records[i].size;
+    }
+    std::sort(index.begin(), index.end(), [](const IndexEntry &a, const IndexEntry &b) {
+        return std::memcmp(a.key, b.key, KEY_SIZE) < 0;
+    });
+
+    Header header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    std::memcpy(header.config, m_config.constData(), KEY_SIZE);
+    header.entryCount = index.size();
+    header.indexOffset = offset;
+    header.fileSize = offset + index.size() * sizeof(IndexEntry);
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const auto &record : records) {
+        out.write(reinterpret_cast<const char *>(record.data), static_cast<qint64>(record.size));
+    }
+    out.write(reinterpret_cast<const char *>(index.data()), static_cast<qint64>(index.size() * sizeof(IndexEntry)));
+
+    // The old mapping must go before the file is replaced
+    close();
+    const bool committed = out.commit();
+    if (committed) {
+        m_pending.clear();
+        m_used.clear();
+    } else {
+        // The old file is still in place; the new entries stay pending for
+        // the next save
+        qWarning() << "Could not write fingerprint store:" << m_path;
+    }
+    open();
+    return committed;
+}
@@ -0,0 +1,72 @@
+#ifndef FINGERPRINT_STORE_H
+#define FINGERPRINT_STORE_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+#include "Rabin_karp.h"
+#include <string>
+#include <vector>
+
+// On-disk cache of preprocessed text and fingerprints, keyed by a hash of
+// the file content. The store file is memory-mapped and used in place: a
+// sorted index at the end is binary-searched and records are copied
+// straight out of the mapping, so opening it costs no parse step. A
+// configuration tag (k, window, hash and preprocessor versions) is stored
+// in the header; a store written with another configuration is ignored.
+//
+// The layout uses native byte order, as the file is a local cache. New
+// entries are kept in memory until save(), which rewrites the store
+// atomically. All public functions may be called from several threads.
+class FingerprintStore {
+public:
+    FingerprintStore(const QString &path, const QByteArray &configTag, qint64 maxBytes = 512ll << 20);
+    ~FingerprintStore();
+
+    FingerprintStore(const FingerprintStore &) = delete;
+    FingerprintStore &operator=(const FingerprintStore &) = delete;
+
+    // Key of a file's raw bytes; files fingerprinted in different modes
+    // get different keys
+    static QByteArray contentKey(QByteArrayView content, bool tokenMode);
+
+    bool lookup(const QByteArray &key, std::string &processedContent, std::vector<uint32_t> &tokens,
+                RabinKarp::FileFingerprints &fingerprints);
+    void insert(const QByteArray &key, const std::string &processedContent, const std::vector<uint32_t> &tokens,
+                const RabinKarp::FileFingerprints &fingerprints);
+
+    // Writes the entries used or added since opening first, then older ones
+    // while the store stays below maxBytes. Does nothing when no entry was
+    // added.
+    bool save();
+
+private:
+    struct Span {
+        const uchar *data = nullptr;
+        qint64 size = 0;
+    };
+
+    void open();
+    void close();
+    Span findRecord(const QByteArray &key) const;
+
+    QString m_path;
+    QByteArray m_config;
+    qint64 m_maxBytes;
+
+    QFile m_file;
+    const uchar *m_map = nullptr;
+    qint64 m_mapSize = 0;
+    quint64 m_entryCount = 0;
+    quint64 m_indexOffset = 0;
+
+    QMutex m_mutex;
+    QSet<QByteArray> m_used;
+    QHash<QByteArray, QByteArray> m_pending;
+};
+
+#endif // FINGERPRINT_STORE_H
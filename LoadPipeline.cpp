@@ -0,0 +1,230 @@
+#include "LoadPipeline.h"
+#include "BaseCodeFilter.h"
+#include "BoundedQueue.h"
+#include "FingerprintStore.h"
+#include "Preprocessor.h"
+#include "Profiler.h"
+#include "SourceFile.h"
+#include <QThread>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+// A file that has been read but not yet preprocessed
+struct LoadJob {
+    int index = 0;
+    std::unique_ptr<SourceFile> source;
+    QByteArray key;
+};
+}
+
+LoadPipeline::LoadPipeline(const Options &options, FingerprintStore *store)
+    : m_options(options), m_store(store)
+{
+    if (m_options.processors <= 0) {
+        m_options.processors = qMax(1, QThread::idealThreadCount());
+    }
+    m_options.readers = qMax(1, m_options.readers);
+}
+
+QString LoadPipeline::errorString() const
+{
+    return m_error;
+}
+
+void LoadPipeline::setCancellationToken(const CancellationToken *token)
+{
+    m_cancellation = token;
+}
+
+void LoadPipeline::setProgressCallback(ProgressCallback callback)
+{
+    m_progress = std::move(callback);
+}
+
+void LoadPipeline::setBaseFilter(const BaseCodeFilter *filter)
+{
+    m_baseFilter = filter;
+}
+
+bool LoadPipeline::run(std::vector<FileContent> &files, const std::vector<QString> &localPaths,
+                       const std::vector<int> &pending, const std::vector<int> &preloaded,
+                       const std::function<void(int)> &onReady)
+{
+    m_error.clear();
+
+    const int processorCount = m_options.processors;
+    const int readerCount = qMin(m_options.readers, static_cast<int>(pending.size()));
+    const bool tokenMode = m_options.tokenMode;
+    BoundedQueue<LoadJob> toProcess(static_cast<size_t>(processorCount) * 2);
+    BoundedQueue<int> ready(static_cast<size_t>(processorCount) * 2);
+
+    std::atomic<bool> failed{false};
+    std::mutex errorMutex;
+    auto fail = [&](const QString &message) {
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!failed.exchange(true)) {
+                m_error = message;
+            }
+        }
+        toProcess.close();
+        ready.close();
+    };
+
+    // A cancelled run stops like a failed one, without an error message
+    auto cancelled = [&]() {
+        if (m_cancellation && m_cancellation->isCancelled()) {
+            fail(QString());
+            return true;
+        }
+        return false;
+    };
+
+    std::atomic<size_t> nextPending{0};
+    std::atomic<int> activeReaders{readerCount};
+    std::atomic<int> activeProcessors{processorCount};
+    const RabinKarp rk(m_options.windowSize);
+
+    auto reader = [&]() {
+        size_t next;
+        while (!failed && (next = nextPending++) < pending.size()) {
+            if (cancelled()) break;
+            const int index = pending[next];
+            LoadJob job;
+            job.index = index;
+            job.source = std::make_unique<SourceFile>();
+            bool opened;
+            {
+                Profiler::Scope scope(Profiler::ReadFile);
+                opened = job.source->open(localPaths[index]);
+            }
+            if (!opened) {
+                fail(tr("Failed to open file: %1").arg(localPaths[index]));
+                break;
+            }
+            Profiler::add(Profiler::BytesRead, static_cast<uint64_t>(job.source->bytes().size()));
+            if (job.source->text().empty()) {
+                fail(tr("File is empty: %1").arg(localPaths[index]));
+                break;
+            }
+
+            // Files seen in an earlier run only cost the read
+            FileContent &fc = files[index];
+            if (m_store) {
+                bool found;
+                {
+                    Profiler::Scope scope(Profiler::StoreLookup);
+                    job.key = FingerprintStore::contentKey(job.source->bytes(), tokenMode);
+                    found = m_store->lookup(job.key, fc.processedContent, fc.tokens, fc.fingerprints);
+                }
+                if (found) {
+                    Profiler::add(Profiler::StoreHits);
+                    Profiler::add(Profiler::FilesLoaded);
+                    if (m_baseFilter) {
+                        Profiler::add(Profiler::BaseCodeDropped, m_baseFilter->apply(fc.fingerprints));
+                    }
+                    if (!ready.push(index)) break;
+                    continue;
+                }
+            }
+            if (!toProcess.push(std::move(job))) break;
+        }
+        if (--activeReaders == 0) {
+            toProcess.close();
+        }
+    };
+
+    auto processor = [&]() {
+        Preprocessor preprocessor;
+        LoadJob job;
+        while (!failed && toProcess.pop(job)) {
+            if (cancelled()) break;
+            FileContent &fc = files[job.index];
+            const QString &localPath = localPaths[job.index];
+            try {
+                // The preprocessor reads the mapped UTF-8 bytes directly
+                preprocessor.preprocess(job.source->text(), fc.processedContent);
+
+                if (fc.processedContent.empty()) {
+                    fail(tr("Failed to process file: %1").arg(localPath));
+                    break;
+                }
+                if (cancelled()) break;
+
+                if (tokenMode) {
+                    fc.tokens = preprocessor.tokenize(job.source->text());
+                    fc.fingerprints = rk.fingerprint(fc.tokens, m_options.k);
+                } else {
+                    fc.fingerprints = rk.fingerprint(fc.processedContent, m_options.k);
+                }
+            } catch (const std::exception &e) {
+                fail(tr("Preprocessing error for %1: %2").arg(localPath, e.what()));
+                break;
+            }
+
+            if (m_store) {
+                m_store->insert(job.key, fc.processedContent, fc.tokens, fc.fingerprints);
+            }
+            Profiler::add(Profiler::FilesLoaded);
+            if (m_baseFilter) {
+                Profiler::add(Profiler::BaseCodeDropped, m_baseFilter->apply(fc.fingerprints));
+            }
+            job.source.reset();
+            if (!ready.push(job.index)) break;
+        }
+        if (--activeProcessors == 0) {
+            ready.close();
+        }
+    };
+
+    if (readerCount == 0) {
+        toProcess.close();
+    }
+    std::vector<std::thread> threads;
+    for (int i = 0; i < readerCount; ++i) {
+        threads.emplace_back(reader);
+    }
+    for (int i = 0; i < processorCount; ++i) {
+        threads.emplace_back(processor);
+    }
+
+    const size_t total = preloaded.size() + pending.size();
+    size_t finished = 0;
+    auto finish = [&](int index) {
+        if (m_progress) {
+            m_progress(++finished, total);
+        }
+        onReady(index);
+    };
+
+    std::exception_ptr consumerError;
+    try {
+        for (int index : preloaded) {
+            if (failed || cancelled()) break;
+            finish(index);
+        }
+        int index;
+        while (!failed && ready.pop(index)) {
+            finish(index);
+        }
+    } catch (...) {
+        consumerError = std::current_exception();
+        fail(QString());
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    if (consumerError) {
+        std::rethrow_exception(consumerError);
+    }
+    if (m_cancellation) {
+        m_cancellation->throwIfCancelled();
+    }
+    return !failed;
+}
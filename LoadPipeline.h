@@ -0,0 +1,77 @@
+#ifndef LOAD_PIPELINE_H
+#define LOAD_PIPELINE_H
+
+#include <QCoreApplication>
+#include <QString>
+#include "Cancellation.h"
+#include "Rabin_karp.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+class BaseCodeFilter;
+class FingerprintStore;
+
+struct FileContent {
+    QString path;
+    std::string processedContent;
+    std::vector<uint32_t> tokens;  // only filled in token mode
+    RabinKarp::FileFingerprints fingerprints;
+};
+
+// Loads, preprocesses and fingerprints a set of files in three stages
+// connected by bounded queues: reader threads map and hash files (and answer
+// from the fingerprint store when there is one), processor threads
+// preprocess and fingerprint, and the calling thread consumes finished
+// files. A full queue stalls the stage feeding it, so only a few files per
+// processor are held in memory at once.
+class LoadPipeline {
+    Q_DECLARE_TR_FUNCTIONS(LoadPipeline)
+
+public:
+    struct Options {
+        int k = 5;
+        int windowSize = 0;
+        bool tokenMode = false;
+        int readers = 2;     // reading is I/O bound, a couple keep the disk busy
+        int processors = 0;  // 0 uses QThread::idealThreadCount()
+    };
+
+    explicit LoadPipeline(const Options &options, FingerprintStore *store = nullptr);
+
+    // Loads files[i] from localPaths[i] for every i in pending; files[i].path
+    // is left as it is. onReady is called on the calling thread with the
+    // index of every finished file, starting with the already loaded ones in
+    // preloaded, while the rest are still loading. Stops at the first error
+    // and returns false; errorString() then describes it. Exceptions thrown
+    // by onReady stop the pipeline and are rethrown; so is OperationCancelled
+    // when the cancellation token fires.
+    bool run(std::vector<FileContent> &files, const std::vector<QString> &localPaths,
+             const std::vector<int> &pending, const std::vector<int> &preloaded,
+             const std::function<void(int)> &onReady);
+
+    QString errorString() const;
+
+    // Polled before every read, preprocessing and fingerprinting step. The
+    // token must outlive the pipeline.
+    void setCancellationToken(const CancellationToken *token);
+
+    // Called on the calling thread with the number of finished files, just
+    // before onReady
+    void setProgressCallback(ProgressCallback callback);
+
+    // Removes base code from the fingerprints of every loaded file; the
+    // store keeps them unfiltered. Files in preloaded are left as they are.
+    // The filter must outlive the pipeline.
+    void setBaseFilter(const BaseCodeFilter *filter);
+
+private:
+    Options m_options;
+    FingerprintStore *m_store;
+    const CancellationToken *m_cancellation = nullptr;
+    const BaseCodeFilter *m_baseFilter = nullptr;
+    ProgressCallback m_progress;
+    QString m_error;
+};
+
+#endif // LOAD_PIPELINE_H
@@ -15,15 +15,21 @@ Window {
     title: "Plagiarism Detector"
 
     property bool darkMode: false
+    // Folders and archives added next to the two file cards; the backend
+    // collects the source files in them
+    property var extraInputs: []
+
+    function comparisonInputs() {
+        let inputs = [];
+        if (fileCard1.localFilePath) inputs.push(fileCard1.localFilePath);
+        if (fileCard2.localFilePath) inputs.push(fileCard2.localFilePath);
+        return inputs.concat(extraInputs);
+    }
 
     // Backend connection
     Backend {
         id: backend
-        onComparisonFinished: function(similarityScore, matches) {
-            resultModel.clear();
-            for (var i = 0; i < matches.length; i++) {
-                resultModel.append(matches[i]);
-            }
+        onComparisonFinished: function(similarityScore, pairCount) {
             overallScore.text = `Overall Similarity: ${similarityScore.toFixed(2)}%`;
             overallScore.color = getScoreColor(similarityScore);
 
@@ -35,7 +41,18 @@ Window {
                 warningDialog.open();
             }
         }
+        onResultsUpdated: function(similarityScore, pairCount, changedFiles) {
+            overallScore.text = `Overall Similarity: ${similarityScore.toFixed(2)}%`;
+            overallScore.color = getScoreColor(similarityScore);
+        }
+        onMatchDetailReady: function(file1, file2, segments) {
+            if (file1 === detailDialog.file1Path && file2 === detailDialog.file2Path) {
+                detailDialog.segments = segments;
+                detailDialog.detailsLoading = false;
+            }
+        }
         onErrorOccurred: function(message) {
+            detailDialog.detailsLoading = false;
             errorDialog.text = message;
             errorDialog.open();
         }
@@ -45,6 +62,12 @@ Window {
         id: fileReader
     }
 
+    function formatEta(seconds) {
+        if (seconds < 60) return `${seconds} s`;
+        if (seconds < 3600) return `${Math.floor(seconds / 60)} min ${seconds % 60} s`;
+        return `${Math.floor(seconds / 3600)} h ${Math.floor(seconds / 60) % 60} min`;
+    }
+
     function getScoreColor(score) {
         if (score > 70) return "#FF5252";
         if (score > 40) return "#FF9800";
@@ -64,6 +87,41 @@ Window {
         buttons: MessageDialog.Ok
     }
 
+    // Starter code is left out of every comparison
+    FileDialog {
+        id: baseFileDialog
+        title: "Select Starter Code"
+        fileMode: FileDialog.OpenFiles
+        nameFilters: [
+            "Source files (*.cpp *.h *.py *.java *.js *.txt)",
+            "All files (*)"
+        ]
+        onAccepted: {
+            backend.baseFiles = selectedFiles.map(file => file.toString());
+        }
+    }
+
+    FolderDialog {
+        id: folderDialog
+        title: "Add Submission Folder"
+        onAccepted: {
+            extraInputs = extraInputs.concat([selectedFolder.toString()]);
+        }
+    }
+
+    FileDialog {
+        id: archiveDialog
+        title: "Add Submission Archives"
+        fileMode: FileDialog.OpenFiles
+        nameFilters: [
+            "Archives (*.zip *.tar *.tar.gz *.tgz)",
+            "All files (*)"
+        ]
+        onAccepted: {
+            extraInputs = extraInputs.concat(selectedFiles.map(file => file.toString()));
+        }
+    }
+
     // Header
     Rectangle {
         id: toolbar
@@ -186,13 +244,103 @@ Window {
                             Layout.alignment: Qt.AlignHCenter
                             spacing: 10
 
+                            Button {
+                                text: backend.baseFiles.length > 0 ?
+                                          `Starter Code (${backend.baseFiles.length})` : "Starter Code..."
+                                enabled: !backend.processing
+                                onClicked: baseFileDialog.open()
+                                background: Rectangle {
+                                    radius: 5
+                                    color: parent.down ? (darkMode ? "#555555" : "#e0e0e0") :
+                                          (parent.hovered ? (darkMode ? "#444444" : "#f0f0f0") :
+                                                           (darkMode ? "#333333" : "#ffffff"))
+                                    border.color: darkMode ? "#666666" : "#cccccc"
+                                    border.width: 1
+                                }
+                            }
+
+                            Button {
+                                text: "Clear Starter Code"
+                                visible: backend.baseFiles.length > 0
+                                enabled: !backend.processing
+                                onClicked: backend.baseFiles = []
+                                background: Rectangle {
+                                    radius: 5
+                                    color: parent.down ? (darkMode ? "#555555" : "#e0e0e0") :
+                                          (parent.hovered ? (darkMode ? "#444444" : "#f0f0f0") :
+                                                           (darkMode ? "#333333" : "#ffffff"))
+                                    border.color: darkMode ? "#666666" : "#cccccc"
+                                    border.width: 1
+                                }
+                            }
+
+                            // Resubmitted files are rescored as soon as they are saved
+                            CheckBox {
+                                id: watchCheckBox
+                                text: "Rescore on Save"
+                                checked: backend.watchFiles
+                                onToggled: backend.watchFiles = checked
+                                contentItem: Label {
+                                    text: watchCheckBox.text
+                                    color: darkMode ? "white" : "black"
+                                    leftPadding: watchCheckBox.indicator.width + watchCheckBox.spacing
+                                    verticalAlignment: Text.AlignVCenter
+                                }
+                            }
+
+                            Button {
+                                text: extraInputs.length > 0 ?
+                                          `Folders and Archives (${extraInputs.length})` : "Add Folder..."
+                                enabled: !backend.processing
+                                onClicked: folderDialog.open()
+                                background: Rectangle {
+                                    radius: 5
+                                    color: parent.down ? (darkMode ? "#555555" : "#e0e0e0") :
+                                          (parent.hovered ? (darkMode ? "#444444" : "#f0f0f0") :
+                                                           (darkMode ? "#333333" : "#ffffff"))
+                                    border.color: darkMode ? "#666666" : "#cccccc"
+                                    border.width: 1
+                                }
+                            }
+
+                            Button {
+                                text: "Add Archives..."
+                                enabled: !backend.processing
+                                onClicked: archiveDialog.open()
+                                background: Rectangle {
+                                    radius: 5
+                                    color: parent.down ? (darkMode ? "#555555" : "#e0e0e0") :
+                                          (parent.hovered ? (darkMode ? "#444444" : "#f0f0f0") :
+                                                           (darkMode ? "#333333" : "#ffffff"))
+                                    border.color: darkMode ? "#666666" : "#cccccc"
+                                    border.width: 1
+                                }
+                            }
+
+                            Button {
+                                text: "Clear Folders and Archives"
+                                visible: extraInputs.length > 0
+                                enabled: !backend.processing
+                                onClicked: extraInputs = []
+                                background: Rectangle {
+                                    radius: 5
+                                    color: parent.down ? (darkMode ? "#555555" : "#e0e0e0") :
+                                          (parent.hovered ? (darkMode ? "#444444" : "#f0f0f0") :
+                                                           (darkMode ? "#333333" : "#ffffff"))
+                                    border.color: darkMode ? "#666666" : "#cccccc"
+                                    border.width: 1
+                                }
+                            }
+
                             Button {
                                 text: "Check for Plagiarism"
-                                enabled: fileCard1.localFilePath && fileCard2.localFilePath && !backend.processing
+                                // Two files, or any folder or archive, which may hold many
+                                enabled: ((fileCard1.localFilePath && fileCard2.localFilePath) ||
+                                          extraInputs.length > 0) && !backend.processing
                                 onClicked: {
-                                    if (fileCard1.localFilePath && fileCard2.localFilePath) {
-                                        var files = [fileCard1.localFilePath, fileCard2.localFilePath];
-                                        backend.processFiles(files);
+                                    const inputs = comparisonInputs();
+                                    if (inputs.length >= 2 || extraInputs.length > 0) {
+                                        backend.processFiles(inputs);
                                     } else {
                                         errorDialog.text = "Please select both files first";
                                         errorDialog.open();
@@ -222,10 +370,32 @@ Window {
                         }
 
                         BusyIndicator {
-                            running: backend.processing
+                            running: backend.processing && backend.progressTotal === 0
                             Layout.alignment: Qt.AlignHCenter
                             visible: running
                         }
+
+                        ColumnLayout {
+                            Layout.alignment: Qt.AlignHCenter
+                            visible: backend.processing && backend.progressTotal > 0
+                            spacing: 5
+
+                            ProgressBar {
+                                Layout.preferredWidth: 320
+                                from: 0
+                                to: backend.progressTotal
+                                value: backend.progressDone
+                            }
+
+                            Label {
+                                Layout.alignment: Qt.AlignHCenter
+                                color: darkMode ? "white" : "black"
+                                text: {
+                                    var status = `${backend.progressStage}: ${backend.progressDone} / ${backend.progressTotal}`;
+                                    return backend.progressEta >= 0 ? `${status}, ${formatEta(backend.progressEta)} left` : status;
+                                }
+                            }
+                        }
                     }
                 }
 
@@ -251,7 +421,7 @@ Window {
                             ListView {
                                 id: resultView
                                 width: parent.width
-                                model: ListModel { id: resultModel }
+                                model: backend.results
                                 delegate: resultDelegate
                                 spacing: 10
                             }
@@ -372,6 +542,9 @@ Window {
         property string file1Path: ""
         property string file2Path: ""
         property real similarityScore: 0
+        property var segments: []
+        property bool detailsLoading: false
+        property bool syncing: false
 
         title: "Detailed Comparison"
         standardButtons: Dialog.Ok
@@ -381,8 +554,81 @@ Window {
 
         onOpened: {
             if (file1Path && file2Path) {
-                file1Text.text = fileReader.readFile(file1Path);
-                file2Text.text = fileReader.readFile(file2Path);
+                // The line models only style the lines the views show
+                file1Lines.source = file1Path;
+                file2Lines.source = file2Path;
+                // Match runs are only computed once a pair is opened
+                segments = [];
+                detailsLoading = true;
+                backend.requestMatchDetail(file1Path, file2Path);
+            }
+        }
+
+        onSegmentsChanged: {
+            file1Lines.setHighlights(segments.map(s => ({ start: s.start1, end: s.end1 })));
+            file2Lines.setHighlights(segments.map(s => ({ start: s.start2, end: s.end2 })));
+            if (segments.length > 0) {
+                syncing = true;
+                file1View.positionViewAtIndex(file1Lines.lineAt(segments[0].start1), ListView.Center);
+                file2View.positionViewAtIndex(file2Lines.lineAt(segments[0].start2), ListView.Center);
+                syncing = false;
+            }
+        }
+
+        // Scrolls one pane to the same relative position as the other
+        function syncScroll(from, to) {
+            if (syncing) return;
+            syncing = true;
+            const range = from.contentHeight - from.height;
+            const ratio = range > 0 ? (from.contentY - from.originY) / range : 0;
+            to.contentY = to.originY + ratio * Math.max(0, to.contentHeight - to.height);
+            syncing = false;
+        }
+
+        SourceViewModel {
+            id: file1Lines
+            highlightColor: darkMode ? "#80b8860b" : "#70ffd700"
+            onErrorOccurred: function(message) {
+                errorDialog.text = message;
+                errorDialog.open();
+            }
+        }
+
+        SourceViewModel {
+            id: file2Lines
+            highlightColor: darkMode ? "#80b8860b" : "#70ffd700"
+            onErrorOccurred: function(message) {
+                errorDialog.text = message;
+                errorDialog.open();
+            }
+        }
+
+        Component {
+            id: sourceLineDelegate
+
+            RowLayout {
+                width: ListView.view.width
+                spacing: 8
+
+                Label {
+                    text: model.lineNumber
+                    font.family: "Courier New"
+                    font.pixelSize: 11
+                    color: darkMode ? "#888888" : "#999999"
+                    horizontalAlignment: Text.AlignRight
+                    Layout.preferredWidth: 40
+                    Layout.alignment: Qt.AlignTop
+                }
+
+                Text {
+                    text: model.text
+                    textFormat: Text.RichText
+                    wrapMode: Text.Wrap
+                    font.family: "Courier New"
+                    font.pixelSize: 11
+                    color: darkMode ? "white" : "black"
+                    Layout.fillWidth: true
+                }
             }
         }
 
@@ -411,6 +657,13 @@ Window {
                 Layout.alignment: Qt.AlignHCenter
             }
 
+            Label {
+                text: detailDialog.detailsLoading ? "Finding matching regions..."
+                                                  : "Matching regions: " + detailDialog.segments.length
+                color: darkMode ? "white" : "black"
+                Layout.alignment: Qt.AlignHCenter
+            }
+
             RowLayout {
                 Layout.fillWidth: true
                 Layout.fillHeight: true
@@ -427,21 +680,23 @@ Window {
                         color: darkMode ? "white" : "black"
                     }
 
-                    ScrollView {
+                    Rectangle {
                         Layout.fillWidth: true
                         Layout.fillHeight: true
-                        TextArea {
-                            id: file1Text
-                            readOnly: true
-                            wrapMode: TextEdit.Wrap
-                            font.family: "Courier New"
-                            font.pixelSize: 11
-                            selectByMouse: true
-                            background: Rectangle {
-                                color: darkMode ? "#333333" : "#ffffff"
-                                border.color: darkMode ? "#555555" : "#cccccc"
-                                border.width: 1
-                            }
+                        color: darkMode ? "#333333" : "#ffffff"
+                        border.color: darkMode ? "#555555" : "#cccccc"
+                        border.width: 1
+
+                        ListView {
+                            id: file1View
+                            anchors.fill: parent
+                            anchors.margins: 4
+                            clip: true
+                            model: file1Lines
+                            delegate: sourceLineDelegate
+                            reuseItems: true
+                            ScrollBar.vertical: ScrollBar {}
+                            onContentYChanged: detailDialog.syncScroll(file1View, file2View)
                         }
                     }
                 }
@@ -457,21 +712,23 @@ Window {
                         color: darkMode ? "white" : "black"
                     }
 
-                    ScrollView {
+                    Rectangle {
                         Layout.fillWidth: true
                         Layout.fillHeight: true
-                        TextArea {
-                            id: file2Text
-                            readOnly: true
-                            wrapMode: TextEdit.Wrap
-                            font.family: "Courier New"
-                            font.pixelSize: 11
-                            selectByMouse: true
-                            background: Rectangle {
-                                color: darkMode ? "#333333" : "#ffffff"
-                                border.color: darkMode ? "#555555" : "#cccccc"
-                                border.width: 1
-                            }
+                        color: darkMode ? "#333333" : "#ffffff"
+                        border.color: darkMode ? "#555555" : "#cccccc"
+                        border.width: 1
+
+                        ListView {
+                            id: file2View
+                            anchors.fill: parent
+                            anchors.margins: 4
+                            clip: true
+                            model: file2Lines
+                            delegate: sourceLineDelegate
+                            reuseItems: true
+                            ScrollBar.vertical: ScrollBar {}
+                            onContentYChanged: detailDialog.syncScroll(file2View, file1View)
                         }
                     }
                 }
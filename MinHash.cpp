@@ -0,0 +1,131 @@
+#include "MinHash.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+// splitmix64 finalizer; a different seed per sketch row gives independent
+// permutations of the 64-bit hash space
+inline uint64_t mix(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+}
+
+MinHash::MinHash(const Options &options)
+    : m_options(options)
+{
+    if (m_options.bands == 0 || m_options.rows == 0) {
+        throw std::invalid_argument("MinHash needs at least one band and one row");
+    }
+    if (m_options.threshold < 0.0 || m_options.threshold > 1.0) {
+        throw std::invalid_argument("MinHash threshold must be between 0 and 1");
+    }
+
+    // Fixed seeds so sketches stay comparable across runs
+    m_seeds.resize(sketchSize());
+    uint64_t state = 0x9e3779b97f4a7c15ULL;
+    for (auto &seed : m_seeds) {
+        state += 0x9e3779b97f4a7c15ULL;
+        seed = mix(state);
+    }
+}
+
+const MinHash::Options &MinHash::options() const
+{
+    return m_options;
+}
+
+size_t MinHash::sketchSize() const
+{
+    return m_options.bands * m_options.rows;
+}
+
+MinHash::Sketch MinHash::sketch(const std::vector<long long> &hashes) const
+{
+    Sketch result(m_seeds.size(), std::numeric_limits<uint64_t>::max());
+
+    for (long long hash : hashes) {
+        // The value is mixed once so that nearby fingerprint hashes are
+        // spread out; every row then mixes it again with its own seed, as
+        // xor with a seed alone would give the rows the same order
+        const uint64_t value = mix(static_cast<uint64_t>(hash));
+        for (size_t i = 0; i < m_seeds.size(); ++i) {
+            result[i] = std::min(result[i], mix(value ^ m_seeds[i]));
+        }
+    }
+    return result;
+}
+
+double MinHash::estimateSimilarity(const Sketch &sketch1, const Sketch &sketch2)
+{
+    if (sketch1.size() != sketch2.size()) {
+        throw std::invalid_argument("sketches were built with different sizes");
+    }
+    if (sketch1.empty()) {
+        return 0.0;
+    }
+
+    size_t equal = 0;
+    for (size_t i = 0; i < sketch1.size(); ++i) {
+        equal += sketch1[i] == sketch2[i];
+    }
+    return static_cast<double>(equal) / sketch1.size();
+}
+
+std::vector<std::pair<size_t, size_t>> MinHash::candidatePairs(const std::vector<Sketch> &sketches) const
+{
+    const size_t rows = m_options.rows;
+    for (const auto &sketch : sketches) {
+        if (sketch.size() != sketchSize()) {
+            throw std::invalid_argument("sketch size does not match the band layout");
+        }
+    }
+
+    // Pair keys file1 << 32 | file2, collected from every band bucket
+    std::vector<uint64_t> keys;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+
+    for (size_t band = 0; band < m_options.bands; ++band) {
+        buckets.clear();
+        for (size_t file = 0; file < sketches.size(); ++file) {
+            uint64_t key = band;
+            for (size_t row = 0; row < rows; ++row) {
+                key = mix(key ^ sketches[file][band * rows + row]);
+            }
+            buckets[key].push_back(static_cast<uint32_t>(file));
+        }
+
+        for (const auto &bucket : buckets) {
+            const auto &files = bucket.second;
+            for (size_t a = 0; a < files.size(); ++a) {
+                for (size_t b = a + 1; b < files.size(); ++b) {
+                    keys.push_back(static_cast<uint64_t>(files[a]) << 32 | files[b]);
+                }
+            }
+        }
+    }
+
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    // Bucket keys can collide, and a single matching band says little about
+    // the whole set, so every candidate is checked against the full sketch
+    std::vector<std::pair<size_t, size_t>> pairs;
+    for (uint64_t key : keys) {
+        const size_t file1 = static_cast<size_t>(key >> 32);
+        const size_t file2 = static_cast<size_t>(key & 0xffffffffULL);
+        if (estimateSimilarity(sketches[file1], sketches[file2]) >= m_options.threshold) {
+            pairs.emplace_back(file1, file2);
+        }
+    }
+    return pairs;
+}
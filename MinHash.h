@@ -0,0 +1,48 @@
+#ifndef MINHASH_H
+#define MINHASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// MinHash sketches of fingerprint sets with LSH banding, used to pick the
+// file pairs worth an exact comparison in large corpora. Each sketch holds
+// bands * rows minimum hashes; two files become candidates when all rows of
+// at least one band agree, which happens with probability
+// 1 - (1 - J^rows)^bands for Jaccard similarity J. More bands raise recall,
+// more rows raise precision; the S-curve is steepest near
+// (1 / bands)^(1 / rows).
+class MinHash {
+public:
+    using Sketch = std::vector<uint64_t>;
+
+    struct Options {
+        size_t bands = 32;
+        size_t rows = 4;
+        double threshold = 0.2;  // minimum estimated Jaccard of a candidate
+    };
+
+    explicit MinHash(const Options &options);
+
+    const Options &options() const;
+    size_t sketchSize() const;
+
+    // Sketch of a sorted or unsorted set of fingerprint hashes. An empty set
+    // gives a sketch that only matches other empty sets.
+    Sketch sketch(const std::vector<long long> &hashes) const;
+
+    // Fraction of equal sketch entries, an unbiased estimate of the Jaccard
+    // similarity of the two sets
+    static double estimateSimilarity(const Sketch &sketch1, const Sketch &sketch2);
+
+    // Pairs (file1 < file2) sharing a band bucket whose estimated similarity
+    // reaches the threshold, ordered by file1 then file2
+    std::vector<std::pair<size_t, size_t>> candidatePairs(const std::vector<Sketch> &sketches) const;
+
+private:
+    Options m_options;
+    std::vector<uint64_t> m_seeds;
+};
+
+#endif // MINHASH_H
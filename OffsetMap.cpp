@@ -0,0 +1,84 @@
+#include "OffsetMap.h"
+#include <algorithm>
+
+void OffsetMap::append(size_t processedLength, size_t original, size_t originalLength)
+{
+    if (processedLength == 0) {
+        return;
+    }
+
+    // Extend the previous segment when both map one to one and touch
+    if (processedLength == originalLength && !m_segments.empty()) {
+        Segment &last = m_segments.back();
+        if (segmentLength(m_segments.size() - 1) == last.originalLength &&
+            last.original + last.originalLength == original) {
+            last.originalLength += static_cast<uint32_t>(originalLength);
+            m_processedLength += processedLength;
+            return;
+        }
+    }
+
+    m_segments.push_back({static_cast<uint32_t>(m_processedLength), static_cast<uint32_t>(original),
+                          static_cast<uint32_t>(originalLength)});
+    m_processedLength += processedLength;
+}
+
+void OffsetMap::clear()
+{
+    m_segments.clear();
+    m_processedLength = 0;
+}
+
+void OffsetMap::reserve(size_t segments)
+{
+    m_segments.reserve(segments);
+}
+
+size_t OffsetMap::processedLength() const
+{
+    return m_processedLength;
+}
+
+size_t OffsetMap::segmentCount() const
+{
+    return m_segments.size();
+}
+
+OffsetMap::Range OffsetMap::toOriginal(size_t start, size_t length) const
+{
+    Range range;
+    if (m_segments.empty() || length == 0) {
+        return range;
+    }
+
+    const size_t last = std::min(start + length, m_processedLength) - 1;
+    start = std::min(start, last);
+
+    const size_t first = segmentAt(start);
+    const Segment &begin = m_segments[first];
+    range.begin = begin.original;
+    if (segmentLength(first) == begin.originalLength) {
+        range.begin += start - begin.processed;
+    }
+
+    const size_t lastIndex = segmentAt(last);
+    const Segment &end = m_segments[lastIndex];
+    range.end = end.original + end.originalLength;
+    if (segmentLength(lastIndex) == end.originalLength) {
+        range.end = end.original + (last - end.processed) + 1;
+    }
+    return range;
+}
+
+size_t OffsetMap::segmentAt(size_t position) const
+{
+    auto it = std::upper_bound(m_segments.begin(), m_segments.end(), position,
+                               [](size_t value, const Segment &segment) { return value < segment.processed; });
+    return static_cast<size_t>(it - m_segments.begin()) - 1;
+}
+
+size_t OffsetMap::segmentLength(size_t index) const
+{
+    const size_t next = index + 1 < m_segments.size() ? m_segments[index + 1].processed : m_processedLength;
+    return next - m_segments[index].processed;
+}
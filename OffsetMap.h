@@ -0,0 +1,51 @@
+#ifndef OFFSET_MAP_H
+#define OFFSET_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Maps positions in preprocessed text (or token indices) back to byte
+// ranges of the original source. The map is run-length encoded: a segment
+// whose processed and original lengths are equal maps character by
+// character, any other segment (a replaced identifier, literal or collapsed
+// whitespace) maps as a whole to its original range. Adjacent one-to-one
+// segments are merged, so a file costs one segment per replacement rather
+// than one entry per character. Lookups are a binary search.
+class OffsetMap {
+public:
+    struct Range {
+        size_t begin = 0;
+        size_t end = 0;
+    };
+
+    // The next processedLength processed positions come from the original
+    // bytes [original, original + originalLength)
+    void append(size_t processedLength, size_t original, size_t originalLength);
+
+    void clear();
+    void reserve(size_t segments);
+
+    size_t processedLength() const;
+    size_t segmentCount() const;
+
+    // Original range covered by the processed range [start, start + length);
+    // positions past the end are clamped to the last segment. Empty for an
+    // empty map or length 0.
+    Range toOriginal(size_t start, size_t length) const;
+
+private:
+    struct Segment {
+        uint32_t processed;
+        uint32_t original;
+        uint32_t originalLength;
+    };
+
+    size_t segmentAt(size_t position) const;
+    size_t segmentLength(size_t index) const;
+
+    std::vector<Segment> m_segments;
+    size_t m_processedLength = 0;
+};
+
+#endif // OFFSET_MAP_H
@@ -1,7 +1,10 @@
 #include "Preprocessor.h"
+#include "OffsetMap.h"
+#include "Profiler.h"
 #include <algorithm>
 #include <cctype>
 #include <unordered_set>
+#include <unordered_map>
 #include <sstream>
 
 namespace {
@@ -50,6 +53,23 @@ const std::unordered_set<std::string>& getReservedWordsImpl() {
     };
     return RESERVED_WORDS;
 }
+
+// Reserved words numbered in alphabetical order, so token ids do not
+// depend on the hash set's iteration order
+const std::unordered_map<std::string, uint32_t>& getKeywordIds() {
+    static const std::unordered_map<std::string, uint32_t> KEYWORD_IDS = [] {
+        const auto &words = getReservedWordsImpl();
+        std::vector<std::string> sorted(words.begin(), words.end());
+        std::sort(sorted.begin(), sorted.end());
+
+        std::unordered_map<std::string, uint32_t> ids;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            ids.emplace(sorted[i], Preprocessor::TOKEN_KEYWORD + static_cast<uint32_t>(i));
+        }
+        return ids;
+    }();
+    return KEYWORD_IDS;
+}
 }
 
 Preprocessor::Preprocessor() = default;
@@ -58,306 +78,444 @@ const std::unordered_set<std::string>& Preprocessor::getReservedWords() {
     return getReservedWordsImpl();
 }
 
-std::string Preprocessor::preprocess(const std::string &code) {
-    if (code.empty()) {
-        return "";
+// The normalizer is a chain of small stages. Each stage consumes one
+// character of the previous stage's output and pushes zero or more
+// characters to the next one, so the whole chain runs in one pass over the
+// input and produces exactly what the former pass-per-step pipeline did:
+//   comments -> string literals -> number literals -> whitespace
+//   -> case -> identifiers -> output
+// Every character carries the range of input bytes it stands for, so the
+// output stage can record an offset map in the same pass.
+class Preprocessor::Normalizer {
+public:
+    Normalizer(const Preprocessor &owner, std::string &out, OffsetMap *offsets)
+        : m_owner(owner), m_out(out), m_offsets(offsets)
+    {
+        // Classify every char value once instead of calling into <cctype>
+        // for each character and stage
+        for (int i = 0; i < 256; ++i) {
+            const char c = static_cast<char>(i);
+            unsigned char flags = 0;
+            if (std::isdigit(c)) flags |= Digit;
+            if (std::isspace(c)) flags |= Space;
+            if (std::isalnum(c) || c == '_') flags |= Word;
+            m_classes[i] = flags;
+            m_lower[i] = static_cast<char>(std::tolower(c));
+        }
     }
 
-    std::string processed = code;
+    void run(std::string_view code) {
+        for (size_t i = 0; i < code.size(); ++i) {
+            // CRLF line endings normalize like LF ones
+            if (code[i] == '\r' && i + 1 < code.size() && code[i + 1] == '\n') {
+                continue;
+            }
+            i = stripComments(code, i);
+        }
+        finishNumber();
+        finishWhitespace();
+        finishIdentifier();
+
+        Profiler::add(Profiler::Comments, m_comments);
+        Profiler::add(Profiler::StringLiterals, m_literals);
+        Profiler::add(Profiler::NumberLiterals, m_numbers);
+        Profiler::add(Profiler::Identifiers, m_identifiers);
+    }
 
-    // Apply preprocessing steps in order
-    processed = removeComments(processed);
-    processed = removeStringLiterals(processed);
-    processed = removeNumberLiterals(processed);
-    processed = normalizeWhitespace(processed);
-    processed = normalizeCase(processed);
-    processed = normalizeIdentifiers(processed);
+private:
+    enum CharClass : unsigned char {
+        Digit = 1,
+        Space = 2,
+        Word = 4
+    };
 
-    return processed;
-}
+    // Input bytes [begin, end) a character was derived from
+    struct Source {
+        size_t begin;
+        size_t end;
+    };
 
-std::string Preprocessor::removeComments(const std::string &code) {
-    std::string result;
-    result.reserve(code.size());
-    bool inLineComment = false;
-    bool inBlockComment = false;
-    bool inString = false;
-    bool inChar = false;
-    bool escape = false;
+    bool is(char c, CharClass charClass) const {
+        return m_classes[static_cast<unsigned char>(c)] & charClass;
+    }
 
-    for (size_t i = 0; i < code.size(); ++i) {
+    // Comment removal; needs one character of lookahead, so it works on the
+    // input directly. Returns the index of the last consumed character.
+    size_t stripComments(std::string_view code, size_t i) {
         char c = code[i];
+        const Source src{i, i + 1};
+        const bool inComment = m_inLineComment || m_inBlockComment;
 
         // Handle escape sequences
-        if (escape) {
-            escape = false;
-            if (!inLineComment && !inBlockComment) {
-                result += c;
-            }
-            continue;
+        if (m_escape) {
+            m_escape = false;
+            if (!inComment) pushString(c, src);
+            return i;
         }
 
-        if (c == '\\' && (inString || inChar)) {
-            escape = true;
-            if (!inLineComment && !inBlockComment) {
-                result += c;
-            }
-            continue;
+        if (c == '\\' && (m_inString || m_inChar)) {
+            m_escape = true;
+            if (!inComment) pushString(c, src);
+            return i;
         }
 
         // Handle string literals
-        if (!inLineComment && !inBlockComment) {
-            if (c == '"' && !inChar) {
-                inString = !inString;
-                result += c;
-                continue;
+        if (!inComment) {
+            if (c == '"' && !m_inChar) {
+                m_inString = !m_inString;
+                pushString(c, src);
+                return i;
             }
-            if (c == '\'' && !inString) {
-                inChar = !inChar;
-                result += c;
-                continue;
+            if (c == '\'' && !m_inString) {
+                m_inChar = !m_inChar;
+                pushString(c, src);
+                return i;
             }
         }
 
         // Skip comment processing if we're inside a string
-        if (inString || inChar) {
-            if (!inLineComment && !inBlockComment) {
-                result += c;
-            }
-            continue;
+        if (m_inString || m_inChar) {
+            if (!inComment) pushString(c, src);
+            return i;
         }
 
-        // Handle line comments
-        if (!inBlockComment && i + 1 < code.size() && c == '/' && code[i + 1] == '/') {
-            inLineComment = true;
-            i++; // Skip the second '/'
-            continue;
+        const bool hasNext = i + 1 < code.size();
+
+        if (!m_inBlockComment && hasNext && c == '/' && code[i + 1] == '/') {
+            m_inLineComment = true;
+            ++m_comments;
+            return i + 1;
         }
 
-        // Handle block comments
-        if (!inLineComment && i + 1 < code.size() && c == '/' && code[i + 1] == '*') {
-            inBlockComment = true;
-            i++; // Skip the '*'
-            continue;
+        if (!m_inLineComment && hasNext && c == '/' && code[i + 1] == '*') {
+            m_inBlockComment = true;
+            ++m_comments;
+            return i + 1;
         }
 
-        // End line comment
-        if (inLineComment && c == '\n') {
-            inLineComment = false;
-            result += c; // Keep the newline
-            continue;
+        // A line comment ends at, but keeps, the newline
+        if (m_inLineComment && c == '\n') {
+            m_inLineComment = false;
+            pushString(c, src);
+            return i;
         }
 
-        // End block comment
-        if (inBlockComment && i + 1 < code.size() && c == '*' && code[i + 1] == '/') {
-            inBlockComment = false;
-            i++; // Skip the '/'
-            continue;
+        if (m_inBlockComment && hasNext && c == '*' && code[i + 1] == '/') {
+            m_inBlockComment = false;
+            return i + 1;
         }
 
-        // Add character if not in comment
-        if (!inLineComment && !inBlockComment) {
-            result += c;
+        if (!m_inLineComment && !m_inBlockComment) {
+            pushString(c, src);
         }
+        return i;
     }
 
-    return result;
-}
+    // String and character literals become "str" and 'c'
+    void pushString(char c, Source src) {
+        if (m_literalEscape) {
+            m_literalEscape = false;
+            return;
+        }
 
-std::string Preprocessor::normalizeWhitespace(const std::string &code) {
-    std::string result;
-    result.reserve(code.size());
-    bool inSpace = false;
-    bool atLineStart = true;
+        if (c == '\\' && (m_inStringLiteral || m_inCharLiteral)) {
+            m_literalEscape = true;
+            return;
+        }
 
-    for (char c : code) {
-        if (std::isspace(c)) {
-            if (c == '\n') {
-                // Preserve line breaks
-                if (!result.empty() && result.back() != '\n') {
-                    result += '\n';
-                }
-                inSpace = false;
-                atLineStart = true;
-            } else if (!inSpace && !atLineStart) {
-                // Replace multiple spaces with single space, but not at line start
-                result += ' ';
-                inSpace = true;
+        if (!m_inCharLiteral && c == '"') {
+            if (!m_inStringLiteral) {
+                m_inStringLiteral = true;
+                ++m_literals;
+                pushNumber('"', src);
+                pushNumber('s', src);
+                pushNumber('t', src);
+                pushNumber('r', src);
+                pushNumber('"', src);
+            } else {
+                m_inStringLiteral = false;
             }
-        } else {
-            result += c;
-            inSpace = false;
-            atLineStart = false;
+            return;
         }
-    }
-
-    // Remove trailing whitespace
-    while (!result.empty() && std::isspace(result.back())) {
-        result.pop_back();
-    }
-
-    return result;
-}
-
-std::string Preprocessor::normalizeIdentifiers(const std::string &code) {
-    std::string result;
-    std::string currentWord;
-    result.reserve(code.size());
 
-    for (char c : code) {
-        if (std::isalnum(c) || c == '_') {
-            currentWord += c;
-        } else {
-            if (!currentWord.empty()) {
-                // Check if it's a reserved word (case-insensitive)
-                std::string lowerWord = currentWord;
-                std::transform(lowerWord.begin(), lowerWord.end(), lowerWord.begin(), ::tolower);
-
-                if (!isReservedWord(lowerWord) && !isNumeric(currentWord)) {
-                    result += "var";
-                } else {
-                    result += lowerWord; // Use lowercase version
-                }
-                currentWord.clear();
+        if (!m_inStringLiteral && c == '\'') {
+            if (!m_inCharLiteral) {
+                m_inCharLiteral = true;
+                ++m_literals;
+                pushNumber('\'', src);
+                pushNumber('c', src);
+                pushNumber('\'', src);
+            } else {
+                m_inCharLiteral = false;
             }
-            result += c;
+            return;
         }
-    }
-
-    // Handle last word
-    if (!currentWord.empty()) {
-        std::string lowerWord = currentWord;
-        std::transform(lowerWord.begin(), lowerWord.end(), lowerWord.begin(), ::tolower);
 
-        if (!isReservedWord(lowerWord) && !isNumeric(currentWord)) {
-            result += "var";
-        } else {
-            result += lowerWord;
+        if (!m_inStringLiteral && !m_inCharLiteral) {
+            pushNumber(c, src);
         }
     }
 
-    return result;
-}
-
-std::string Preprocessor::removeStringLiterals(const std::string &code) {
-    std::string result;
-    result.reserve(code.size());
-    bool inString = false;
-    bool inChar = false;
-    bool escape = false;
-
-    for (char c : code) {
-        if (escape) {
-            escape = false;
-            continue;
+    // Number literals, including a decimal point and suffixes, become num
+    void pushNumber(char c, Source src) {
+        if (is(c, Digit) || (c == '.' && m_inNumber)) {
+            m_numberSource = m_inNumber ? Source{m_numberSource.begin, src.end} : src;
+            m_inNumber = true;
+            return;
         }
 
-        if (c == '\\' && (inString || inChar)) {
-            escape = true;
-            continue;
+        if (m_inNumber && (c == 'f' || c == 'F' || c == 'l' || c == 'L' ||
+                           c == 'u' || c == 'U')) {
+            m_numberSource.end = src.end;
+            return;
         }
 
-        if (!inChar && c == '"') {
-            if (!inString) {
-                inString = true;
-                result += "\"str\"";
-            } else {
-                inString = false;
-            }
-            continue;
+        finishNumber();
+        pushWhitespace(c, src);
+    }
+
+    void finishNumber() {
+        if (m_inNumber) {
+            m_inNumber = false;
+            ++m_numbers;
+            pushWhitespace('n', m_numberSource);
+            pushWhitespace('u', m_numberSource);
+            pushWhitespace('m', m_numberSource);
         }
+    }
 
-        if (!inString && c == '\'') {
-            if (!inChar) {
-                inChar = true;
-                result += "'c'";
-            } else {
-                inChar = false;
+    // Runs of blanks collapse to one space, blank lines and leading blanks
+    // disappear. Whitespace is held back until a non-space character
+    // follows, which drops trailing whitespace without a final pass.
+    void pushWhitespace(char c, Source src) {
+        if (is(c, Space)) {
+            if (c == '\n') {
+                if (m_hasOutput && m_lastWhitespaceOutput != '\n') {
+                    m_pendingWhitespace += '\n';
+                    m_pendingSources.push_back(src);
+                    m_lastWhitespaceOutput = '\n';
+                }
+                m_inSpace = false;
+                m_atLineStart = true;
+            } else if (!m_inSpace && !m_atLineStart) {
+                m_pendingWhitespace += ' ';
+                m_pendingSources.push_back(src);
+                m_lastWhitespaceOutput = ' ';
+                m_inSpace = true;
             }
-            continue;
+            return;
         }
 
-        if (!inString && !inChar) {
-            result += c;
+        for (size_t i = 0; i < m_pendingWhitespace.size(); ++i) {
+            pushIdentifier(m_pendingWhitespace[i], m_pendingSources[i]);
         }
+        m_pendingWhitespace.clear();
+        m_pendingSources.clear();
+
+        pushIdentifier(m_lower[static_cast<unsigned char>(c)], src);
+        m_hasOutput = true;
+        m_lastWhitespaceOutput = c;
+        m_inSpace = false;
+        m_atLineStart = false;
     }
 
-    return result;
-}
+    void finishWhitespace() {
+        m_pendingWhitespace.clear();
+        m_pendingSources.clear();
+    }
+
+    // Reserved words stay, every other identifier becomes var
+    void pushIdentifier(char c, Source src) {
+        if (is(c, Word)) {
+            m_wordSource = m_word.empty() ? src : Source{m_wordSource.begin, std::max(m_wordSource.end, src.end)};
+            m_word += c;
+            return;
+        }
 
-std::string Preprocessor::removeNumberLiterals(const std::string &code) {
-    std::string result;
-    result.reserve(code.size());
-    std::string currentNumber;
-    bool inNumber = false;
+        finishIdentifier();
+        m_out += c;
+        record(1, src);
+    }
 
-    for (size_t i = 0; i < code.size(); ++i) {
-        char c = code[i];
+    void finishIdentifier() {
+        if (m_word.empty()) {
+            return;
+        }
 
-        if (std::isdigit(c) || (c == '.' && inNumber)) {
-            if (!inNumber) {
-                inNumber = true;
-            }
-            currentNumber += c;
-        } else if (inNumber && (c == 'f' || c == 'F' || c == 'l' || c == 'L' ||
-                                c == 'u' || c == 'U')) {
-            // Handle number suffixes
-            currentNumber += c;
+        if (!m_owner.isReservedWord(m_word) && !m_owner.isNumeric(m_word)) {
+            ++m_identifiers;
+            m_out += "var";
+            record(3, m_wordSource);
         } else {
-            if (inNumber) {
-                result += "num";
-                currentNumber.clear();
-                inNumber = false;
-            }
-            result += c;
+            m_out += m_word;
+            record(m_word.size(), m_wordSource);
         }
+        m_word.clear();
     }
 
-    // Handle number at end of string
-    if (inNumber) {
-        result += "num";
+    void record(size_t length, Source src) {
+        if (m_offsets) {
+            m_offsets->append(length, src.begin, src.end - src.begin);
+        }
     }
 
-    return result;
+    const Preprocessor &m_owner;
+    std::string &m_out;
+    OffsetMap *m_offsets;
+    unsigned char m_classes[256];
+    char m_lower[256];
+
+    // Comment stage
+    bool m_inLineComment = false;
+    bool m_inBlockComment = false;
+    bool m_inString = false;
+    bool m_inChar = false;
+    bool m_escape = false;
+
+    // Literal stage
+    bool m_inStringLiteral = false;
+    bool m_inCharLiteral = false;
+    bool m_literalEscape = false;
+
+    // Number stage
+    bool m_inNumber = false;
+    Source m_numberSource{0, 0};
+
+    // Whitespace stage
+    bool m_inSpace = false;
+    bool m_atLineStart = true;
+    bool m_hasOutput = false;
+    char m_lastWhitespaceOutput = '\0';
+    std::string m_pendingWhitespace;
+    std::vector<Source> m_pendingSources;
+
+    // Identifier stage
+    std::string m_word;
+    Source m_wordSource{0, 0};
+
+    // Work done per stage, reported to the profiler once per file
+    uint64_t m_comments = 0;
+    uint64_t m_literals = 0;
+    uint64_t m_numbers = 0;
+    uint64_t m_identifiers = 0;
+};
+
+std::string Preprocessor::preprocess(const std::string &code) {
+    std::string processed;
+    preprocess(code, processed);
+    return processed;
 }
 
-std::string Preprocessor::normalizeCase(const std::string &code) {
-    std::string result = code;
+void Preprocessor::preprocess(std::string_view code, std::string &out, OffsetMap *offsets) {
+    out.clear();
+    if (offsets) {
+        offsets->clear();
+    }
+    if (code.empty()) {
+        return;
+    }
+
+    Profiler::Scope scope(Profiler::Preprocess);
+    out.reserve(code.size());
+    Normalizer normalizer(*this, out, offsets);
+    normalizer.run(code);
+    Profiler::add(Profiler::ProcessedBytes, out.size());
+}
 
-    // Only normalize non-string content
-    bool inString = false;
-    bool inChar = false;
-    bool escape = false;
+std::vector<uint32_t> Preprocessor::tokenize(std::string_view code, OffsetMap *offsets) const {
+    Profiler::Scope scope(Profiler::Tokenize);
+    std::vector<uint32_t> tokens;
+    tokens.reserve(code.size() / 4);
+    if (offsets) {
+        offsets->clear();
+    }
 
-    for (size_t i = 0; i < result.size(); ++i) {
-        char c = result[i];
+    // Called once i is past the token
+    size_t i = 0;
+    auto emit = [&](uint32_t id, size_t start) {
+        tokens.push_back(id);
+        if (offsets) {
+            offsets->append(1, start, i - start);
+        }
+    };
 
-        if (escape) {
-            escape = false;
+    const auto &keywords = getKeywordIds();
+    std::string word;
+    const size_t n = code.size();
+    uint64_t comments = 0;
+    uint64_t literals = 0;
+    uint64_t numbers = 0;
+    uint64_t identifiers = 0;
+
+    while (i < n) {
+        const unsigned char c = static_cast<unsigned char>(code[i]);
+        const size_t start = i;
+
+        if (std::isspace(c)) {
+            ++i;
             continue;
         }
 
-        if (c == '\\' && (inString || inChar)) {
-            escape = true;
+        // Comments
+        if (c == '/' && i + 1 < n && code[i + 1] == '/') {
+            i = code.find('\n', i + 2);
+            if (i == std::string_view::npos) i = n;
+            ++comments;
+            continue;
+        }
+        if (c == '/' && i + 1 < n && code[i + 1] == '*') {
+            i = code.find("*/", i + 2);
+            i = (i == std::string_view::npos) ? n : i + 2;
+            ++comments;
             continue;
         }
 
-        if (!inChar && c == '"') {
-            inString = !inString;
+        // String and character literals, honouring escapes
+        if (c == '"' || c == '\'') {
+            for (++i; i < n && code[i] != static_cast<char>(c); ++i) {
+                if (code[i] == '\\') ++i;
+            }
+            i = std::min(i + 1, n);
+            emit(c == '"' ? TOKEN_STR : TOKEN_CHAR, start);
+            ++literals;
             continue;
         }
 
-        if (!inString && c == '\'') {
-            inChar = !inChar;
+        // Numbers, including hex digits, a decimal point and suffixes
+        if (std::isdigit(c)) {
+            while (i < n && (std::isalnum(static_cast<unsigned char>(code[i])) ||
+                             code[i] == '.' || code[i] == '_')) {
+                ++i;
+            }
+            emit(TOKEN_NUM, start);
+            ++numbers;
             continue;
         }
 
-        if (!inString && !inChar) {
-            result[i] = std::tolower(c);
+        // Identifiers and reserved words
+        if (std::isalpha(c) || c == '_') {
+            word.clear();
+            while (i < n && (std::isalnum(static_cast<unsigned char>(code[i])) || code[i] == '_')) {
+                word += static_cast<char>(std::tolower(static_cast<unsigned char>(code[i])));
+                ++i;
+            }
+            auto it = keywords.find(word);
+            identifiers += it == keywords.end();
+            emit(it != keywords.end() ? it->second : static_cast<uint32_t>(TOKEN_IDENT), start);
+            continue;
         }
+
+        // Operators and punctuation
+        ++i;
+        emit(c, start);
     }
 
-    return result;
+    Profiler::add(Profiler::Tokens, tokens.size());
+    Profiler::add(Profiler::Comments, comments);
+    Profiler::add(Profiler::StringLiterals, literals);
+    Profiler::add(Profiler::NumberLiterals, numbers);
+    Profiler::add(Profiler::Identifiers, identifiers);
+    return tokens;
 }
 
 bool Preprocessor::isReservedWord(const std::string &word) const {
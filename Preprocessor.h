@@ -1,24 +1,54 @@
 #ifndef PREPROCESSOR_H
 #define PREPROCESSOR_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <unordered_set>
+#include <vector>
+
+class OffsetMap;
 
 class Preprocessor {
 public:
+    // Token ids produced by tokenize(). Single-character operators and
+    // punctuation use their byte value; reserved words are numbered from
+    // TOKEN_KEYWORD in alphabetical order.
+    enum TokenId : uint32_t {
+        TOKEN_IDENT = 256,
+        TOKEN_NUM,
+        TOKEN_STR,
+        TOKEN_CHAR,
+        TOKEN_KEYWORD
+    };
+
+    // Bumped whenever preprocess() or tokenize() output changes, so stored
+    // fingerprints of older builds are not reused
+    static constexpr int VERSION = 1;
+
     Preprocessor();
 
     std::string preprocess(const std::string &code);
 
+    // Same normalization as preprocess(), written into a caller-provided
+    // buffer. out is cleared first; its capacity is reused. When offsets is
+    // given it receives the map from positions in out to bytes of code,
+    // built during the same pass.
+    void preprocess(std::string_view code, std::string &out, OffsetMap *offsets = nullptr);
+
+    // Token-stream alternative to preprocess(): comments and whitespace are
+    // dropped, literals become TOKEN_NUM/STR/CHAR, reserved words keep their
+    // own id and every other identifier becomes TOKEN_IDENT. When offsets is
+    // given it receives the map from token indices to bytes of code.
+    std::vector<uint32_t> tokenize(std::string_view code, OffsetMap *offsets = nullptr) const;
+
     static const std::unordered_set<std::string>& getReservedWords();
 
 private:
-    std::string removeComments(const std::string &code);
-    std::string normalizeWhitespace(const std::string &code);
-    std::string normalizeCase(const std::string &code);
-    std::string removeStringLiterals(const std::string &code);
-    std::string removeNumberLiterals(const std::string &code);
-    std::string normalizeIdentifiers(const std::string &code);
+    // Single-pass state machine that removes comments, replaces string and
+    // number literals, collapses whitespace, lowercases and normalizes
+    // identifiers while streaming the input once
+    class Normalizer;
 
     bool isReservedWord(const std::string &word) const;
     bool isNumeric(const std::string &word) const;
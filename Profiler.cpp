@@ -0,0 +1,226 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+namespace {
+// Stages recorded as trace events; the per-pair ones would swamp a trace
+// with millions of tiny slices and are only summed up
+constexpr bool TRACED[Profiler::StageCount] = {
+    true,   // Collect
+    true,   // ReadFile
+    true,   // StoreLookup
+    true,   // Preprocess
+    true,   // Tokenize
+    true,   // Fingerprint
+    true,   // IndexBuild
+    true,   // Scoring
+    true,   // Compare
+    false,  // Intersection
+    false,  // MatchExtraction
+    true,   // Marshalling
+};
+
+const char *const STAGE_NAMES[Profiler::StageCount] = {
+    "collect", "read-file", "store-lookup", "preprocess", "tokenize", "fingerprint",
+    "index-build", "scoring", "compare", "intersection", "match-extraction", "marshalling",
+};
+
+const char *const COUNTER_NAMES[Profiler::CounterCount] = {
+    "bytes-read", "files-loaded", "store-hits", "processed-bytes", "tokens", "comments",
+    "string-literals", "number-literals", "identifiers", "fingerprints", "base-code-dropped", "postings",
+    "longest-posting-list", "pairs-scored", "pairs-pruned", "match-runs", "hash-collisions",
+    "results-published", "files-collected", "duplicate-files",
+};
+
+// Large runs would otherwise grow the trace without bound
+constexpr size_t MAX_TRACE_EVENTS = size_t(1) << 20;
+
+struct StageSlot {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> nanoseconds{0};
+};
+
+struct TraceEvent {
+    int stage;
+    int thread;
+    int64_t start;
+    int64_t duration;
+};
+
+std::array<StageSlot, Profiler::StageCount> g_stages;
+std::atomic<bool> g_tracing{false};
+std::atomic<int64_t> g_epoch{0};
+std::mutex g_traceMutex;
+std::vector<TraceEvent> g_trace;
+
+std::atomic<int> g_nextThread{1};
+thread_local int t_thread = 0;
+
+int threadNumber()
+{
+    if (t_thread == 0) {
+        t_thread = g_nextThread.fetch_add(1, std::memory_order_relaxed);
+    }
+    return t_thread;
+}
+}
+
+int64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+    if (enabled && g_epoch.load() == 0) {
+        g_epoch = now();
+    }
+    s_enabled = enabled;
+}
+
+bool Profiler::isTracing()
+{
+    return g_tracing;
+}
+
+void Profiler::setTracing(bool tracing)
+{
+    g_tracing = tracing;
+}
+
+void Profiler::reset()
+{
+    for (auto &slot : g_stages) {
+        slot.calls = 0;
+        slot.nanoseconds = 0;
+    }
+    for (auto &counter : s_counters) {
+        counter = 0;
+    }
+    std::lock_guard<std::mutex> lock(g_traceMutex);
+    g_trace.clear();
+    g_epoch = now();
+}
+
+void Profiler::raise(Counter counter, uint64_t value)
+{
+    if (!isEnabled()) return;
+    uint64_t current = s_counters[counter].load(std::memory_order_relaxed);
+    while (current < value &&
+           !s_counters[counter].compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+void Profiler::finish(Stage stage, int64_t start)
+{
+    const int64_t duration = now() - start;
+    g_stages[stage].calls.fetch_add(1, std::memory_order_relaxed);
+    g_stages[stage].nanoseconds.fetch_add(static_cast<uint64_t>(duration), std::memory_order_relaxed);
+
+    if (TRACED[stage] && g_tracing.load(std::memory_order_relaxed)) {
+        const TraceEvent event{stage, threadNumber(), start, duration};
+        std::lock_guard<std::mutex> lock(g_traceMutex);
+        if (g_trace.size() < MAX_TRACE_EVENTS) {
+            g_trace.push_back(event);
+        }
+    }
+}
+
+Profiler::Snapshot Profiler::snapshot()
+{
+    Snapshot result;
+    for (size_t i = 0; i < StageCount; ++i) {
+        result.stages[i].calls = g_stages[i].calls;
+        result.stages[i].nanoseconds = g_stages[i].nanoseconds;
+    }
+    for (size_t i = 0; i < CounterCount; ++i) {
+        result.counters[i] = s_counters[i];
+    }
+    return result;
+}
+
+const char *Profiler::stageName(Stage stage)
+{
+    return STAGE_NAMES[stage];
+}
+
+const char *Profiler::counterName(Counter counter)
+{
+    return COUNTER_NAMES[counter];
+}
+
+bool Profiler::writeTrace(const std::string &path, std::string *error)
+{
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(g_traceMutex);
+        events = g_trace;
+    }
+    std::sort(events.begin(), events.end(), [](const TraceEvent &a, const TraceEvent &b) {
+        return a.start < b.start;
+    });
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        if (error) *error = "cannot open " + path + " for writing";
+        return false;
+    }
+
+    // Timestamps are microseconds since the last reset
+    const int64_t epoch = g_epoch;
+    char line[256];
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    int64_t end = 0;
+    for (const auto &event : events) {
+        std::snprintf(line, sizeof(line),
+                      "{\"name\":\"%s\",\"cat\":\"hashtrace\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,"
+                      "\"ts\":%.3f,\"dur\":%.3f},\n",
+                      STAGE_NAMES[event.stage], event.thread, (event.start - epoch) / 1000.0,
+                      event.duration / 1000.0);
+        out << line;
+        end = std::max(end, event.start + event.duration - epoch);
+    }
+
+    // The totals as one counter sample at the end of the trace
+    const Snapshot totals = snapshot();
+    std::snprintf(line, sizeof(line), "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{",
+                  end / 1000.0);
+    out << line;
+    for (size_t i = 0; i < CounterCount; ++i) {
+        std::snprintf(line, sizeof(line), "%s\"%s\":%" PRIu64, i ? "," : "", COUNTER_NAMES[i], totals.counters[i]);
+        out << line;
+    }
+    out << "}}\n]}\n";
+
+    out.flush();
+    if (!out) {
+        if (error) *error = "failed to write " + path;
+        return false;
+    }
+    return true;
+}
+
+std::string Profiler::summary()
+{
+    const Snapshot totals = snapshot();
+    std::string text;
+    char line[128];
+    for (size_t i = 0; i < StageCount; ++i) {
+        if (totals.stages[i].calls == 0) continue;
+        std::snprintf(line, sizeof(line), "%-18s %12" PRIu64 " calls %12.3f ms\n", STAGE_NAMES[i],
+                      totals.stages[i].calls, totals.stages[i].nanoseconds / 1e6);
+        text += line;
+    }
+    for (size_t i = 0; i < CounterCount; ++i) {
+        std::snprintf(line, sizeof(line), "%-20s %16" PRIu64 "\n", COUNTER_NAMES[i], totals.counters[i]);
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,123 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Process-wide stage timers and counters for the hot paths: reading,
+// preprocessing, fingerprinting, indexing, set intersection, match
+// extraction and result marshalling. Off by default; while off, every hook
+// is one relaxed atomic load. While on, a stage costs two clock reads and a
+// counter one relaxed atomic add, so hooks sit at per-file or per-pair
+// granularity and never inside the inner loops.
+//
+// With tracing on as well, the coarse stages (per file, per comparison
+// pass) are recorded as Chrome trace events. writeTrace() saves them as
+// JSON that chrome://tracing and ui.perfetto.dev open.
+class Profiler {
+public:
+    enum Stage {
+        Collect,          // expanding directories and archives, hashing content
+        ReadFile,
+        StoreLookup,
+        Preprocess,
+        Tokenize,
+        Fingerprint,
+        IndexBuild,       // posting lists of the fingerprint index
+        Scoring,          // shared-fingerprint counts from the index
+        Compare,          // one whole comparison pass of the engine
+        Intersection,     // sorted-set intersection of one pair
+        MatchExtraction,  // matches or match runs of one pair
+        Marshalling,      // results handed to the model or writer
+        StageCount
+    };
+
+    enum Counter {
+        BytesRead,
+        FilesLoaded,
+        StoreHits,
+        ProcessedBytes,
+        Tokens,
+        Comments,           // comments removed by the preprocessor
+        StringLiterals,     // string and character literals replaced
+        NumberLiterals,
+        Identifiers,        // identifiers renamed to var
+        Fingerprints,       // selected by winnowing
+        BaseCodeDropped,    // fingerprints removed as starter code
+        Postings,
+        LongestPostingList,
+        PairsScored,
+        PairsPruned,        // skipped by a query's bounds
+        MatchRuns,
+        HashCollisions,     // hits whose texts differ; k-gram matches only checked while profiling
+        ResultsPublished,
+        FilesCollected,
+        DuplicateFiles,
+        CounterCount
+    };
+
+    struct StageStats {
+        uint64_t calls = 0;
+        uint64_t nanoseconds = 0;
+    };
+
+    struct Snapshot {
+        std::array<StageStats, StageCount> stages{};
+        std::array<uint64_t, CounterCount> counters{};
+    };
+
+    // Times the enclosing block as one call of stage
+    class Scope {
+    public:
+        explicit Scope(Stage stage) : m_stage(stage), m_start(isEnabled() ? now() : -1) {}
+        ~Scope()
+        {
+            if (m_start >= 0) finish(m_stage, m_start);
+        }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+
+    private:
+        Stage m_stage;
+        int64_t m_start;
+    };
+
+    static bool isEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool enabled);
+    static bool isTracing();
+    static void setTracing(bool tracing);
+
+    // Zeroes all stages and counters and drops the recorded trace
+    static void reset();
+
+    static void add(Counter counter, uint64_t value = 1)
+    {
+        if (isEnabled()) s_counters[counter].fetch_add(value, std::memory_order_relaxed);
+    }
+    // For counters that hold a maximum
+    static void raise(Counter counter, uint64_t value);
+
+    static Snapshot snapshot();
+    static const char *stageName(Stage stage);
+    static const char *counterName(Counter counter);
+
+    // Recorded trace events plus the final counters, in the Chrome trace
+    // event format. Returns false and sets error when the file cannot be
+    // written.
+    static bool writeTrace(const std::string &path, std::string *error = nullptr);
+
+    // Stages and counters as readable text, one per line
+    static std::string summary();
+
+private:
+    static int64_t now();
+    static void finish(Stage stage, int64_t start);
+
+    static inline std::atomic<bool> s_enabled{false};
+    static inline std::array<std::atomic<uint64_t>, CounterCount> s_counters{};
+};
+
+#endif // PROFILER_H
@@ -1,9 +1,409 @@
 #include "Rabin_karp.h"
+#include "Profiler.h"
 #include <cmath>
 #include <algorithm>
 #include <stdexcept>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <map>
 
-double RabinKarp::computeSimilarity(const std::string &text1, const std::string &text2, int k)
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#endif
+
+namespace {
+constexpr uint64_t HASH_MOD = RabinKarp::MOD;
+constexpr uint64_t HASH_BASE = RabinKarp::BASE;
+
+// a * b mod 2^61 - 1; the modulus is a Mersenne prime, so the reduction is
+// a shift and an add instead of a division
+constexpr uint64_t mulMod(uint64_t a, uint64_t b)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    const uint64_t folded = (static_cast<uint64_t>(product) & HASH_MOD) +
+                            static_cast<uint64_t>(product >> 61);
+#else
+    // 32-bit limbs for compilers without a 128-bit integer type
+    const uint64_t a0 = a & 0xffffffffULL, a1 = a >> 32;
+    const uint64_t b0 = b & 0xffffffffULL, b1 = b >> 32;
+    const uint64_t high = a1 * b1;
+    const uint64_t mid = a1 * b0 + a0 * b1;
+    const uint64_t low = a0 * b0;
+    // 2^64 = 8 and 2^61 = 1 modulo 2^61 - 1
+    const uint64_t sum = (high << 3) + (mid >> 29) + ((mid & 0x1fffffffULL) << 32) +
+                         (low & HASH_MOD) + (low >> 61);
+    const uint64_t folded = (sum & HASH_MOD) + (sum >> 61);
+#endif
+    return folded >= HASH_MOD ? folded - HASH_MOD : folded;
+}
+
+constexpr uint64_t addMod(uint64_t a, uint64_t b)
+{
+    const uint64_t sum = a + b;
+    return sum >= HASH_MOD ? sum - HASH_MOD : sum;
+}
+
+constexpr uint64_t subMod(uint64_t a, uint64_t b)
+{
+    return a >= b ? a - b : a + HASH_MOD - b;
+}
+
+constexpr uint64_t powMod(uint64_t base, int exponent)
+{
+    uint64_t result = 1;
+    for (int i = 0; i < exponent; ++i) {
+        result = mulMod(result, base);
+    }
+    return result;
+}
+
+constexpr uint64_t symbolValue(char c) { return static_cast<unsigned char>(c); }
+constexpr uint64_t symbolValue(uint32_t token) { return token; }
+
+// Rolling hash of every window of k symbols. K > 0 fixes the window size
+// at compile time so BASE^K is a constant and the first window is unrolled;
+// K == 0 reads the size from k. The outgoing symbol's term is computed off
+// the hash's dependency chain, which only carries one multiplication.
+template <int K, typename Symbol>
+void rollWindows(const Symbol *symbols, size_t length, int k, long long *out)
+{
+    constexpr uint64_t FIXED_POWER = K > 0 ? powMod(HASH_BASE, K) : 0;
+    const size_t window = K > 0 ? static_cast<size_t>(K) : static_cast<size_t>(k);
+    const uint64_t power = K > 0 ? FIXED_POWER : powMod(HASH_BASE, k);
+
+    // Compute initial window hash
+    uint64_t hash = 0;
+    for (size_t i = 0; i < window; ++i) {
+        hash = addMod(mulMod(hash, HASH_BASE), symbolValue(symbols[i]));
+    }
+    out[0] = static_cast<long long>(hash);
+
+    // hash' = hash * BASE - out * BASE^k + in
+    for (size_t i = window; i < length; ++i) {
+        const uint64_t outgoing = mulMod(symbolValue(symbols[i - window]), power);
+        const uint64_t incoming = subMod(symbolValue(symbols[i]), outgoing);
+        hash = addMod(mulMod(hash, HASH_BASE), incoming);
+        out[i - window + 1] = static_cast<long long>(hash);
+    }
+}
+
+template <typename Sequence>
+std::vector<long long> rollingHashes(const Sequence &symbols, int k)
+{
+    std::vector<long long> hashes;
+    const size_t length = symbols.size();
+
+    if (k <= 0 || length < static_cast<size_t>(k)) {
+        return hashes;
+    }
+    hashes.resize(length - k + 1);
+
+    // Specialized kernels for the common window sizes
+    switch (k) {
+    case 5:  rollWindows<5>(symbols.data(), length, k, hashes.data()); break;
+    case 8:  rollWindows<8>(symbols.data(), length, k, hashes.data()); break;
+    case 16: rollWindows<16>(symbols.data(), length, k, hashes.data()); break;
+    case 32: rollWindows<32>(symbols.data(), length, k, hashes.data()); break;
+    default: rollWindows<0>(symbols.data(), length, k, hashes.data()); break;
+    }
+
+    return hashes;
+}
+
+// Never use windows longer than the shorter input
+template <typename Sequence>
+int clampK(const Sequence &a, const Sequence &b, int k)
+{
+    const size_t min_len = std::min(a.size(), b.size());
+    return static_cast<size_t>(k) > min_len ? static_cast<int>(min_len) : k;
+}
+
+RabinKarp::FileFingerprints makeFileFingerprints(std::vector<RabinKarp::Fingerprint> fingerprints,
+                                                 size_t length, int k)
+{
+    RabinKarp::FileFingerprints result;
+    result.k = k;
+    result.textLength = length;
+    result.fingerprints = std::move(fingerprints);
+
+    result.uniqueHashes.reserve(result.fingerprints.size());
+    for (const auto &fp : result.fingerprints) {
+        result.uniqueHashes.push_back(fp.hash);
+    }
+    std::sort(result.uniqueHashes.begin(), result.uniqueHashes.end());
+    result.uniqueHashes.erase(std::unique(result.uniqueHashes.begin(), result.uniqueHashes.end()),
+                              result.uniqueHashes.end());
+    Profiler::add(Profiler::Fingerprints, result.fingerprints.size());
+
+    return result;
+}
+
+// Sorted-set intersection kernels. All of them count the values present in
+// both strictly increasing arrays.
+
+size_t intersectScalar(const long long *a, size_t na, const long long *b, size_t nb)
+{
+    size_t count = 0;
+    size_t i = 0, j = 0;
+    while (i < na && j < nb) {
+        const long long x = a[i];
+        const long long y = b[j];
+        count += (x == y);
+        i += (x <= y);
+        j += (y <= x);
+    }
+    return count;
+}
+
+// Scalar merge that gives up once the shorter remainder cannot lift the
+// count to minimum; checked once per block to keep the loop tight
+size_t intersectBounded(const long long *a, size_t na, const long long *b, size_t nb, size_t minimum)
+{
+    constexpr size_t BLOCK = 64;
+    size_t count = 0;
+    size_t i = 0, j = 0;
+    while (i < na && j < nb) {
+        if (count + std::min(na - i, nb - j) < minimum) {
+            return count;
+        }
+        const size_t stop = std::min(i + BLOCK, na);
+        while (i < stop && j < nb) {
+            const long long x = a[i];
+            const long long y = b[j];
+            count += (x == y);
+            i += (x <= y);
+            j += (y <= x);
+        }
+    }
+    return count;
+}
+
+// For very different sizes: exponential then binary search of every value
+// of the small set in the remaining part of the large one
+size_t intersectGalloping(const long long *small, size_t ns, const long long *large, size_t nl)
+{
+    size_t count = 0;
+    size_t low = 0;
+    for (size_t i = 0; i < ns && low < nl; ++i) {
+        const long long value = small[i];
+
+        size_t step = 1;
+        size_t high = low;
+        while (high < nl && large[high] < value) {
+            low = high + 1;
+            high += step;
+            step *= 2;
+        }
+        high = std::min(high + 1, nl);
+
+        const long long *found = std::lower_bound(large + low, large + high, value);
+        low = static_cast<size_t>(found - large);
+        if (low < nl && large[low] == value) {
+            count++;
+            low++;
+        }
+    }
+    return count;
+}
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define RABIN_KARP_X86_KERNELS 1
+
+// Block merge: compare a block of one set against every rotation of a
+// block of the other, then advance whichever block ends lower
+__attribute__((target("avx2")))
+size_t intersectAvx2(const long long *a, size_t na, const long long *b, size_t nb)
+{
+    size_t count = 0;
+    size_t i = 0, j = 0;
+    while (i + 4 <= na && j + 4 <= nb) {
+        const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+        const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+
+        __m256i hits = _mm256_cmpeq_epi64(va, vb);
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x39)));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x4e)));
+        hits = _mm256_or_si256(hits, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x93)));
+        count += static_cast<size_t>(__builtin_popcount(_mm256_movemask_pd(_mm256_castsi256_pd(hits))));
+
+        const long long lastA = a[i + 3];
+        const long long lastB = b[j + 3];
+        i += (lastA <= lastB) ? 4 : 0;
+        j += (lastB <= lastA) ? 4 : 0;
+    }
+    return count + intersectScalar(a + i, na - i, b + j, nb - j);
+}
+#endif
+
+using IntersectKernel = size_t (*)(const long long *, size_t, const long long *, size_t);
+
+// AVX2 block merge when the CPU has it, picked once. A two-lane SSE4.1
+// variant is not worth it: it loses to the branchless scalar merge.
+// HASHTRACE_NO_AVX2 in the environment keeps the scalar merge, so the
+// tests can check both on the same machine.
+IntersectKernel mergeKernel()
+{
+    static const IntersectKernel kernel = [] {
+#ifdef RABIN_KARP_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && !std::getenv("HASHTRACE_NO_AVX2")) return &intersectAvx2;
+#endif
+        return &intersectScalar;
+    }();
+    return kernel;
+}
+
+using Hit = std::pair<size_t, size_t>;
+
+// Positions of the fingerprints both inputs share, skipping hashes so
+// common in the first input that they would produce a cross product of
+// positions; grouped by diagonal (pos1 - pos2), in text order along each
+std::vector<Hit> diagonalHits(const RabinKarp::FileFingerprints &fp1, const RabinKarp::FileFingerprints &fp2,
+                              size_t maxPostings)
+{
+    std::vector<Hit> hits;
+    if (fp1.fingerprints.empty() || fp2.fingerprints.empty()) return hits;
+
+    std::unordered_map<long long, std::vector<size_t>> hashPositions;
+    for (const auto &fp : fp1.fingerprints) {
+        hashPositions[fp.hash].push_back(fp.position);
+    }
+    for (const auto &fp : fp2.fingerprints) {
+        auto it = hashPositions.find(fp.hash);
+        if (it == hashPositions.end() || (maxPostings > 0 && it->second.size() > maxPostings)) {
+            continue;
+        }
+        for (size_t pos1 : it->second) {
+            hits.emplace_back(pos1, fp.position);
+        }
+    }
+
+    std::sort(hits.begin(), hits.end(), [](const Hit &a, const Hit &b) {
+        const auto diagonalA = static_cast<long long>(a.first) - static_cast<long long>(a.second);
+        const auto diagonalB = static_cast<long long>(b.first) - static_cast<long long>(b.second);
+        return diagonalA != diagonalB ? diagonalA < diagonalB : a.first < b.first;
+    });
+    return hits;
+}
+
+bool sameDiagonal(const Hit &a, const Hit &b)
+{
+    return a.first - a.second == b.first - b.second;
+}
+
+// Greedy string tiling: longest runs first, each stretch of either text
+// belongs to at most one run. Returns the kept runs in text order.
+std::vector<RabinKarp::MatchRun> tileRuns(std::vector<RabinKarp::MatchRun> candidates)
+{
+    std::sort(candidates.begin(), candidates.end(), [](const RabinKarp::MatchRun &a, const RabinKarp::MatchRun &b) {
+        if (a.length != b.length) return a.length > b.length;
+        if (a.start1 != b.start1) return a.start1 < b.start1;
+        return a.start2 < b.start2;
+    });
+
+    std::map<size_t, size_t> tiles1;
+    std::map<size_t, size_t> tiles2;
+    auto overlaps = [](const std::map<size_t, size_t> &tiles, size_t start, size_t end) {
+        auto next = tiles.lower_bound(start);
+        if (next != tiles.end() && next->first < end) return true;
+        if (next != tiles.begin() && std::prev(next)->second > start) return true;
+        return false;
+    };
+
+    std::vector<RabinKarp::MatchRun> runs;
+    for (const auto &run : candidates) {
+        const size_t end1 = run.start1 + run.length;
+        const size_t end2 = run.start2 + run.length;
+        if (overlaps(tiles1, run.start1, end1) || overlaps(tiles2, run.start2, end2)) {
+            continue;
+        }
+        tiles1.emplace(run.start1, end1);
+        tiles2.emplace(run.start2, end2);
+        runs.push_back(run);
+    }
+
+    std::sort(runs.begin(), runs.end(), [](const RabinKarp::MatchRun &a, const RabinKarp::MatchRun &b) {
+        return a.start1 != b.start1 ? a.start1 < b.start1 : a.start2 < b.start2;
+    });
+    return runs;
+}
+
+// Runs along the diagonals, checked against the inputs themselves: hits
+// whose k-grams differ are hash collisions and are dropped, and every run
+// is extended over all the matching symbols on both sides, so its length
+// is that of the whole common stretch. Runs that grow into each other on
+// one diagonal are merged.
+template <typename Sequence>
+std::vector<RabinKarp::MatchRun> extendedRuns(std::vector<Hit> hits, const Sequence &a, const Sequence &b,
+                                              size_t k, size_t maxGap, size_t minLength)
+{
+    const size_t before = hits.size();
+    hits.erase(std::remove_if(hits.begin(), hits.end(), [&](const Hit &hit) {
+        return hit.first + k > a.size() || hit.second + k > b.size() ||
+               !std::equal(a.begin() + hit.first, a.begin() + hit.first + k, b.begin() + hit.second);
+    }), hits.end());
+    Profiler::add(Profiler::HashCollisions, before - hits.size());
+
+    std::vector<RabinKarp::MatchRun> candidates;
+    size_t runStart = 0;
+    for (size_t i = 1; i <= hits.size(); ++i) {
+        const bool sameRun = i < hits.size() && sameDiagonal(hits[i], hits[i - 1]) &&
+                             hits[i].first - hits[i - 1].first <= maxGap;
+        if (sameRun) continue;
+
+        size_t start1 = hits[runStart].first;
+        size_t start2 = hits[runStart].second;
+        size_t end1 = hits[i - 1].first + k;
+        size_t end2 = hits[i - 1].second + k;
+        runStart = i;
+        while (start1 > 0 && start2 > 0 && a[start1 - 1] == b[start2 - 1]) {
+            --start1;
+            --start2;
+        }
+        while (end1 < a.size() && end2 < b.size() && a[end1] == b[end2]) {
+            ++end1;
+            ++end2;
+        }
+
+        // The previous run on this diagonal already reaches this one
+        if (!candidates.empty()) {
+            auto &last = candidates.back();
+            if (last.start1 - last.start2 == start1 - start2 && last.start1 + last.length >= start1) {
+                last.length = std::max(last.start1 + last.length, end1) - last.start1;
+                continue;
+            }
+        }
+        candidates.push_back({start1, start2, end1 - start1});
+    }
+
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [minLength](const RabinKarp::MatchRun &run) {
+        return run.length < minLength;
+    }), candidates.end());
+    return tileRuns(std::move(candidates));
+}
+}
+
+RabinKarp::RabinKarp(int windowSize)
+{
+    setWindowSize(windowSize);
+}
+
+void RabinKarp::setWindowSize(int windowSize)
+{
+    if (windowSize < 0) {
+        throw std::invalid_argument("winnowing window size must not be negative");
+    }
+    m_windowSize = windowSize;
+}
+
+int RabinKarp::windowSize() const
+{
+    return m_windowSize;
+}
+
+double RabinKarp::computeSimilarity(const std::string &text1, const std::string &text2, int k) const
 {
     if (k <= 0) {
         throw std::invalid_argument("k-gram size must be positive");
@@ -13,55 +413,137 @@ double RabinKarp::computeSimilarity(const std::string &text1, const std::string
     if (text1.empty() || text2.empty()) return 0.0;
 
     // Use minimum length to prevent generating more hashes than necessary
-    const size_t min_len = std::min(text1.length(), text2.length());
-    if (static_cast<size_t>(k) > min_len) {
-        k = static_cast<int>(min_len);
+    k = clampK(text1, text2, k);
+
+    return computeSimilarity(fingerprint(text1, k), fingerprint(text2, k));
+}
+
+double RabinKarp::computeSimilarity(const std::vector<uint32_t> &tokens1, const std::vector<uint32_t> &tokens2, int k) const
+{
+    if (k <= 0) {
+        throw std::invalid_argument("k-gram size must be positive");
+    }
+
+    if (tokens1.empty() && tokens2.empty()) return 1.0;
+    if (tokens1.empty() || tokens2.empty()) return 0.0;
+
+    k = clampK(tokens1, tokens2, k);
+
+    return computeSimilarity(fingerprint(tokens1, k), fingerprint(tokens2, k));
+}
+
+std::vector<std::pair<size_t, size_t>> RabinKarp::findMatches(const std::string &text1, const std::string &text2, int k) const {
+    if (k <= 0 || text1.empty() || text2.empty()) return {};
+
+    // Ensure k doesn't exceed text lengths
+    k = clampK(text1, text2, k);
+
+    return findMatches(fingerprint(text1, k), fingerprint(text2, k));
+}
+
+std::vector<std::pair<size_t, size_t>> RabinKarp::findMatches(const std::vector<uint32_t> &tokens1, const std::vector<uint32_t> &tokens2, int k) const
+{
+    if (k <= 0 || tokens1.empty() || tokens2.empty()) return {};
+
+    k = clampK(tokens1, tokens2, k);
+
+    return findMatches(fingerprint(tokens1, k), fingerprint(tokens2, k));
+}
+
+RabinKarp::FileFingerprints RabinKarp::fingerprint(const std::string &text, int k) const
+{
+    if (k <= 0) {
+        throw std::invalid_argument("k-gram size must be positive");
     }
 
-    auto set1 = generateUniqueHashes(text1, k);
-    auto set2 = generateUniqueHashes(text2, k);
+    Profiler::Scope scope(Profiler::Fingerprint);
+    return makeFileFingerprints(generateFingerprints(text, k), text.length(), k);
+}
+
+RabinKarp::FileFingerprints RabinKarp::fingerprint(const std::vector<uint32_t> &tokens, int k) const
+{
+    if (k <= 0) {
+        throw std::invalid_argument("k-gram size must be positive");
+    }
+
+    Profiler::Scope scope(Profiler::Fingerprint);
+    return makeFileFingerprints(generateFingerprints(tokens, k), tokens.size(), k);
+}
+
+double RabinKarp::computeSimilarity(const FileFingerprints &fp1, const FileFingerprints &fp2) const
+{
+    if (fp1.k != fp2.k) {
+        throw std::invalid_argument("fingerprints were generated with different k-gram sizes");
+    }
+
+    const auto &set1 = fp1.uniqueHashes;
+    const auto &set2 = fp2.uniqueHashes;
 
     if (set1.empty() && set2.empty()) return 1.0;
     if (set1.empty() || set2.empty()) return 0.0;
 
     // Compute Jaccard similarity coefficient
-    size_t intersection = 0;
-    for (const auto &h : set1) {
-        if (set2.count(h)) intersection++;
-    }
-
+    size_t intersection = intersectionSize(set1, set2);
     size_t union_size = set1.size() + set2.size() - intersection;
     return static_cast<double>(intersection) / union_size;
 }
 
-std::vector<std::pair<size_t, size_t>> RabinKarp::findMatches(const std::string &text1, const std::string &text2, int k) {
-    std::vector<std::pair<size_t, size_t>> matches;
-    if (k <= 0 || text1.empty() || text2.empty()) return matches;
+size_t RabinKarp::intersectionSize(const std::vector<long long> &set1, const std::vector<long long> &set2)
+{
+    const std::vector<long long> &small = set1.size() <= set2.size() ? set1 : set2;
+    const std::vector<long long> &large = set1.size() <= set2.size() ? set2 : set1;
+    if (small.empty()) {
+        return 0;
+    }
 
-    // Ensure k doesn't exceed text lengths
-    const size_t min_len = std::min(text1.length(), text2.length());
-    if (static_cast<size_t>(k) > min_len) {
-        k = static_cast<int>(min_len);
+    Profiler::Scope scope(Profiler::Intersection);
+
+    // Galloping wins once one set is much larger than the other
+    if (large.size() / small.size() >= 32) {
+        return intersectGalloping(small.data(), small.size(), large.data(), large.size());
     }
+    return mergeKernel()(small.data(), small.size(), large.data(), large.size());
+}
+
+size_t RabinKarp::intersectionSize(const std::vector<long long> &set1, const std::vector<long long> &set2,
+                                   size_t minimum)
+{
+    const size_t smaller = std::min(set1.size(), set2.size());
+    const size_t larger = std::max(set1.size(), set2.size());
+    if (smaller < minimum) {
+        return 0;
+    }
+    // Without a bound the vector kernels are faster, and galloping only
+    // touches a few values of the large set anyway
+    if (minimum == 0 || larger / smaller >= 32) {
+        return intersectionSize(set1, set2);
+    }
+    Profiler::Scope scope(Profiler::Intersection);
+    return intersectBounded(set1.data(), set1.size(), set2.data(), set2.size(), minimum);
+}
 
-    auto hashes1 = generateHashes(text1, k);
-    auto hashes2 = generateHashes(text2, k);
+std::vector<std::pair<size_t, size_t>> RabinKarp::findMatches(const FileFingerprints &fp1, const FileFingerprints &fp2) const
+{
+    if (fp1.k != fp2.k) {
+        throw std::invalid_argument("fingerprints were generated with different k-gram sizes");
+    }
 
-    if (hashes1.empty() || hashes2.empty()) return matches;
+    std::vector<std::pair<size_t, size_t>> matches;
+    if (fp1.fingerprints.empty() || fp2.fingerprints.empty()) return matches;
 
     // Create a map of hash values to their positions in text1
     std::unordered_map<long long, std::vector<size_t>> hashPositions;
-    for (size_t i = 0; i < hashes1.size(); ++i) {
-        hashPositions[hashes1[i]].push_back(i);
+    for (const auto &fp : fp1.fingerprints) {
+        hashPositions[fp.hash].push_back(fp.position);
     }
 
     // Find matches in text2
-    for (size_t j = 0; j < hashes2.size(); ++j) {
-        auto it = hashPositions.find(hashes2[j]);
+    for (const auto &fp : fp2.fingerprints) {
+        auto it = hashPositions.find(fp.hash);
         if (it != hashPositions.end()) {
             // Add all positions where this hash occurs in text1
             for (size_t pos1 : it->second) {
-                matches.emplace_back(pos1, j);
+                matches.emplace_back(pos1, fp.position);
             }
         }
     }
@@ -72,45 +554,133 @@ std::vector<std::pair<size_t, size_t>> RabinKarp::findMatches(const std::string
     return matches;
 }
 
-std::vector<long long> RabinKarp::generateHashes(const std::string &text, int k) const
+std::vector<RabinKarp::MatchRun> RabinKarp::findMatchRuns(const FileFingerprints &fp1, const FileFingerprints &fp2,
+                                                          size_t minRunLength, size_t maxPostings) const
 {
-    std::vector<long long> hashes;
-    const size_t text_len = text.length();
-
-    if (text_len < static_cast<size_t>(k) || k <= 0) {
-        return hashes;
+    if (fp1.k != fp2.k) {
+        throw std::invalid_argument("fingerprints were generated with different k-gram sizes");
     }
 
-    long long hash = 0;
-    long long power = 1;
+    const std::vector<Hit> hits = diagonalHits(fp1, fp2, maxPostings);
+    if (hits.empty()) return {};
 
-    // Precompute power = BASE^(k-1) % MOD
-    for (int i = 0; i < k - 1; ++i) {
-        power = (power * BASE) % MOD;
+    // Consecutive hits on one diagonal extend a run while their k-grams
+    // touch; with winnowing, selected k-grams may be up to a window apart
+    const size_t k = static_cast<size_t>(fp1.k);
+    const size_t maxGap = std::max(k, static_cast<size_t>(m_windowSize));
+    const size_t minLength = std::max(minRunLength, k);
+
+    std::vector<MatchRun> candidates;
+    size_t runStart = 0;
+    for (size_t i = 1; i <= hits.size(); ++i) {
+        const bool sameRun = i < hits.size() && sameDiagonal(hits[i], hits[i - 1]) &&
+                             hits[i].first - hits[i - 1].first <= maxGap;
+        if (sameRun) continue;
+
+        const size_t length = hits[i - 1].first + k - hits[runStart].first;
+        if (length >= minLength) {
+            candidates.push_back({hits[runStart].first, hits[runStart].second, length});
+        }
+        runStart = i;
     }
+    return tileRuns(std::move(candidates));
+}
 
-    // Compute initial window hash
-    for (int i = 0; i < k; ++i) {
-        hash = (hash * BASE + static_cast<unsigned char>(text[i])) % MOD;
+std::vector<RabinKarp::MatchRun> RabinKarp::findMatchRuns(const FileFingerprints &fp1, const FileFingerprints &fp2,
+                                                          std::string_view text1, std::string_view text2,
+                                                          size_t minRunLength, size_t maxPostings) const
+{
+    if (fp1.k != fp2.k) {
+        throw std::invalid_argument("fingerprints were generated with different k-gram sizes");
     }
-    hashes.push_back(hash);
+    const size_t k = static_cast<size_t>(fp1.k);
+    return extendedRuns(diagonalHits(fp1, fp2, maxPostings), text1, text2, k,
+                        std::max(k, static_cast<size_t>(m_windowSize)), std::max(minRunLength, k));
+}
 
-    // Rolling hash for remaining windows
-    for (size_t i = k; i < text_len; ++i) {
-        // Remove leftmost character
-        long long leftChar = static_cast<unsigned char>(text[i - k]);
-        hash = (hash - (leftChar * power) % MOD + MOD) % MOD;
+std::vector<RabinKarp::MatchRun> RabinKarp::findMatchRuns(const FileFingerprints &fp1, const FileFingerprints &fp2,
+                                                          const std::vector<uint32_t> &tokens1,
+                                                          const std::vector<uint32_t> &tokens2,
+                                                          size_t minRunLength, size_t maxPostings) const
+{
+    if (fp1.k != fp2.k) {
+        throw std::invalid_argument("fingerprints were generated with different k-gram sizes");
+    }
+    const size_t k = static_cast<size_t>(fp1.k);
+    return extendedRuns(diagonalHits(fp1, fp2, maxPostings), tokens1, tokens2, k,
+                        std::max(k, static_cast<size_t>(m_windowSize)), std::max(minRunLength, k));
+}
 
-        // Add new character
-        hash = (hash * BASE + static_cast<unsigned char>(text[i])) % MOD;
-        hashes.push_back(hash);
+std::vector<long long> RabinKarp::generateHashes(const std::string &text, int k) const
+{
+    return rollingHashes(text, k);
+}
+
+std::vector<long long> RabinKarp::generateHashes(const std::vector<uint32_t> &tokens, int k) const
+{
+    return rollingHashes(tokens, k);
+}
+
+std::vector<RabinKarp::Fingerprint> RabinKarp::generateFingerprints(const std::string &text, int k) const
+{
+    return selectFingerprints(generateHashes(text, k));
+}
+
+std::vector<RabinKarp::Fingerprint> RabinKarp::generateFingerprints(const std::vector<uint32_t> &tokens, int k) const
+{
+    return selectFingerprints(generateHashes(tokens, k));
+}
+
+std::vector<RabinKarp::Fingerprint> RabinKarp::selectFingerprints(const std::vector<long long> &hashes) const
+{
+    if (m_windowSize > 0) {
+        return winnow(hashes, m_windowSize);
     }
 
-    return hashes;
+    std::vector<Fingerprint> fingerprints;
+    fingerprints.reserve(hashes.size());
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        fingerprints.push_back({hashes[i], i});
+    }
+    return fingerprints;
 }
 
-std::unordered_set<long long> RabinKarp::generateUniqueHashes(const std::string &text, int k) const
+std::vector<RabinKarp::Fingerprint> RabinKarp::winnow(const std::vector<long long> &hashes, int windowSize)
 {
-    auto hashes = generateHashes(text, k);
-    return {hashes.begin(), hashes.end()};
+    std::vector<Fingerprint> selected;
+    if (hashes.empty() || windowSize <= 0) {
+        return selected;
+    }
+
+    const size_t w = static_cast<size_t>(windowSize);
+    selected.reserve(hashes.size() / w * 2 + 1);
+
+    // Monotonic queue of candidate positions; the front is the minimum of
+    // the current window. Ties keep the rightmost position, as in the
+    // original winnowing paper, so runs of equal hashes select few prints.
+    std::deque<size_t> window;
+    size_t lastSelected = hashes.size();
+
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        while (!window.empty() && hashes[window.back()] >= hashes[i]) {
+            window.pop_back();
+        }
+        window.push_back(i);
+
+        if (window.front() + w <= i) {
+            window.pop_front();
+        }
+
+        if (i + 1 >= w && window.front() != lastSelected) {
+            lastSelected = window.front();
+            selected.push_back({hashes[lastSelected], lastSelected});
+        }
+    }
+
+    // Texts shorter than one window still contribute their minimum
+    if (selected.empty()) {
+        selected.push_back({hashes[window.front()], window.front()});
+    }
+
+    return selected;
 }
@@ -1,22 +1,107 @@
 #ifndef RABIN_KARP_H
 #define RABIN_KARP_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_set>
 #include <unordered_map>
 
 class RabinKarp {
 public:
-    static constexpr long long BASE = 256;
-    static constexpr long long MOD = 1000000007;
+    // Polynomial hash modulo the Mersenne prime 2^61 - 1, so reductions need
+    // no division. The base is a fixed, randomly chosen residue; it is kept
+    // constant so fingerprints stay comparable across runs.
+    static constexpr uint64_t MOD = (1ULL << 61) - 1;
+    static constexpr uint64_t BASE = 0x16a09e667f3bcc9ULL;
 
-    double computeSimilarity(const std::string &text1, const std::string &text2, int k = 5);
-    std::vector<std::pair<size_t, size_t>> findMatches(const std::string &text1, const std::string &text2, int k = 5);
+    // A selected k-gram hash and the offset of the k-gram in the text
+    struct Fingerprint {
+        long long hash;
+        size_t position;
+    };
+
+    // Fingerprints of one text, computed once and reused for every pair the
+    // text takes part in
+    struct FileFingerprints {
+        int k = 0;
+        size_t textLength = 0;                  // characters, or tokens
+        std::vector<Fingerprint> fingerprints;  // selected hashes in text order
+        std::vector<long long> uniqueHashes;    // sorted, without duplicates
+    };
+
+    // A stretch of length symbols starting at start1 in the first input that
+    // also occurs at start2 in the second
+    struct MatchRun {
+        size_t start1;
+        size_t start2;
+        size_t length;
+    };
+
+    // windowSize > 0 enables winnowing: only the minimum hash of every
+    // windowSize consecutive k-gram hashes is kept. Any common substring of
+    // at least windowSize + k - 1 characters is still guaranteed to match.
+    explicit RabinKarp(int windowSize = 0);
+
+    void setWindowSize(int windowSize);
+    int windowSize() const;
+
+    double computeSimilarity(const std::string &text1, const std::string &text2, int k = 5) const;
+    std::vector<std::pair<size_t, size_t>> findMatches(const std::string &text1, const std::string &text2, int k = 5) const;
+
+    // Token-stream overloads (see Preprocessor::tokenize); k counts tokens
+    // and match positions are token indices
+    double computeSimilarity(const std::vector<uint32_t> &tokens1, const std::vector<uint32_t> &tokens2, int k = 5) const;
+    std::vector<std::pair<size_t, size_t>> findMatches(const std::vector<uint32_t> &tokens1, const std::vector<uint32_t> &tokens2, int k = 5) const;
+
+    // Overloads on precomputed fingerprints; both sides must use the same k.
+    // Texts shorter than k have no fingerprints.
+    FileFingerprints fingerprint(const std::string &text, int k) const;
+    FileFingerprints fingerprint(const std::vector<uint32_t> &tokens, int k) const;
+    double computeSimilarity(const FileFingerprints &fp1, const FileFingerprints &fp2) const;
+    std::vector<std::pair<size_t, size_t>> findMatches(const FileFingerprints &fp1, const FileFingerprints &fp2) const;
+
+    // Merges fingerprint hits into maximal runs along each diagonal and keeps
+    // non-overlapping runs greedily from the longest (greedy string tiling),
+    // so the output grows with the amount of copied code rather than with
+    // the number of hash collisions. Runs shorter than minRunLength (and
+    // never shorter than k) are dropped; hashes occurring more than
+    // maxPostings times in the first input are ignored (0 = no cap).
+    std::vector<MatchRun> findMatchRuns(const FileFingerprints &fp1, const FileFingerprints &fp2,
+                                        size_t minRunLength = 0, size_t maxPostings = 64) const;
+
+    // Same runs checked against the inputs the fingerprints were built
+    // from: hash collisions are dropped and every run is extended over all
+    // of the text that matches around its hits, so lengths are those of the
+    // whole copied stretch and minRunLength applies to them
+    std::vector<MatchRun> findMatchRuns(const FileFingerprints &fp1, const FileFingerprints &fp2,
+                                        std::string_view text1, std::string_view text2,
+                                        size_t minRunLength = 0, size_t maxPostings = 64) const;
+    std::vector<MatchRun> findMatchRuns(const FileFingerprints &fp1, const FileFingerprints &fp2,
+                                        const std::vector<uint32_t> &tokens1, const std::vector<uint32_t> &tokens2,
+                                        size_t minRunLength = 0, size_t maxPostings = 64) const;
+
+    // Number of values in both sorted, duplicate-free sets. Uses galloping
+    // search for very unequal sizes, an AVX2 block merge when the CPU has
+    // it and a branchless scalar merge otherwise.
+    static size_t intersectionSize(const std::vector<long long> &set1, const std::vector<long long> &set2);
+
+    // Same count for callers that only care whether it reaches minimum: the
+    // merge stops as soon as the values left cannot get there, and the
+    // result is then some count below minimum
+    static size_t intersectionSize(const std::vector<long long> &set1, const std::vector<long long> &set2,
+                                   size_t minimum);
+
+    std::vector<Fingerprint> generateFingerprints(const std::string &text, int k) const;
+    std::vector<Fingerprint> generateFingerprints(const std::vector<uint32_t> &tokens, int k) const;
+    static std::vector<Fingerprint> winnow(const std::vector<long long> &hashes, int windowSize);
 
 private:
     std::vector<long long> generateHashes(const std::string &text, int k) const;
-    std::unordered_set<long long> generateUniqueHashes(const std::string &text, int k) const;
+    std::vector<long long> generateHashes(const std::vector<uint32_t> &tokens, int k) const;
+    std::vector<Fingerprint> selectFingerprints(const std::vector<long long> &hashes) const;
+
+    int m_windowSize = 0;
 };
 
 #endif // RABIN_KARP_H
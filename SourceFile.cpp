@@ -0,0 +1,113 @@
+#include "SourceFile.h"
+#include <QStringDecoder>
+#include <algorithm>
+
+SourceFile::~SourceFile()
+{
+    close();
+}
+
+bool SourceFile::open(const QString &path)
+{
+    close();
+
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        m_error = m_file.errorString();
+        return false;
+    }
+
+    const qint64 size = m_file.size();
+    if (size > 0) {
+        m_map = m_file.map(0, size);
+    }
+    if (m_map) {
+        m_bytes = QByteArrayView(m_map, size);
+    } else {
+        // Pipes, special files and some file systems cannot be mapped
+        m_buffer = m_file.readAll();
+        m_bytes = QByteArrayView(m_buffer);
+    }
+
+    // Only a byte order mark selects another encoding; everything else is
+    // taken as UTF-8, like QTextStream does
+    const auto encoding = QStringConverter::encodingForData(m_bytes);
+    if (!encoding || *encoding == QStringConverter::Utf8) {
+        QByteArrayView text = m_bytes;
+        if (text.startsWith("\xEF\xBB\xBF")) {
+            text = text.sliced(3);
+        }
+        m_text = std::string_view(text.data(), static_cast<size_t>(text.size()));
+    } else {
+        QStringDecoder decoder(*encoding);
+        const QString decoded = decoder.decode(m_bytes);
+        m_converted = decoded.toUtf8();
+        m_text = std::string_view(m_converted.constData(), static_cast<size_t>(m_converted.size()));
+    }
+    return true;
+}
+
+void SourceFile::close()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    m_file.close();
+    m_buffer.clear();
+    m_converted.clear();
+    m_bytes = QByteArrayView();
+    m_text = std::string_view();
+    m_error.clear();
+}
+
+QString SourceFile::errorString() const
+{
+    return m_error;
+}
+
+QByteArrayView SourceFile::bytes() const
+{
+    return m_bytes;
+}
+
+std::string_view SourceFile::text() const
+{
+    return m_text;
+}
+
+QString SourceFile::toString() const
+{
+    QString result = QString::fromUtf8(m_text.data(), static_cast<qsizetype>(m_text.size()));
+    result.replace(QLatin1String("\r\n"), QLatin1String("\n"));
+    return result;
+}
+
+void SourceFile::toDisplayOffsets(std::vector<size_t> &offsets) const
+{
+    // Decodes with the same UTF-8 decoder as toString(), so invalid bytes
+    // become as many replacement characters here as there. The stateful
+    // decoder holds back a sequence split by an offset until it completes.
+    QStringDecoder decoder(QStringDecoder::Utf8);
+    size_t byte = 0;
+    qsizetype decoded = 0;
+    size_t droppedCRs = 0;
+    for (size_t &offset : offsets) {
+        const size_t target = std::min(offset, m_text.size());
+        if (target > byte) {
+            decoded += decoder.decode(QByteArrayView(m_text.data() + byte, static_cast<qsizetype>(target - byte))).size();
+            // The CR of a CRLF is dropped
+            for (; byte < target; ++byte) {
+                if (m_text[byte] == '\r' && byte + 1 < m_text.size() && m_text[byte + 1] == '\n') {
+                    ++droppedCRs;
+                }
+            }
+            if (byte == m_text.size()) {
+                // A sequence cut off by the end of the text is replaced
+                // only once nothing can follow it
+                decoded = QString::fromUtf8(m_text.data(), static_cast<qsizetype>(m_text.size())).size();
+            }
+        }
+        offset = static_cast<size_t>(decoded) - droppedCRs;
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef SOURCE_FILE_H
+#define SOURCE_FILE_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QFile>
+#include <QString>
+#include <string_view>
+#include <vector>
+
+// Read-only view of a source file as UTF-8 bytes. The file is memory-mapped
+// (or read into one buffer when mapping is not possible) and handed out as a
+// std::string_view, so the preprocessor and hasher work on the bytes on
+// disk without a QString round trip. A UTF-8 byte order mark is skipped;
+// UTF-16 and UTF-32 files are transcoded to UTF-8 once. Line endings are
+// left as they are, the preprocessor treats CRLF like LF.
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    bool open(const QString &path);
+    void close();
+    QString errorString() const;
+
+    // Raw file content, as used for content hashing
+    QByteArrayView bytes() const;
+
+    // UTF-8 text without byte order mark; valid until close()
+    std::string_view text() const;
+
+    // Decoded text for display, with CRLF line endings turned into LF
+    QString toString() const;
+
+    // Turns byte offsets into text() into positions in toString(), in
+    // place and in one scan up to the largest offset. The offsets must be
+    // sorted.
+    void toDisplayOffsets(std::vector<size_t> &offsets) const;
+
+private:
+    QFile m_file;
+    uchar *m_map = nullptr;
+    QByteArray m_buffer;     // file content when it could not be mapped
+    QByteArray m_converted;  // UTF-8 copy of UTF-16/32 input
+    QByteArrayView m_bytes;
+    std::string_view m_text;
+    QString m_error;
+};
+
+#endif // SOURCE_FILE_H
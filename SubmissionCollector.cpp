@@ -0,0 +1,563 @@
+#include "SubmissionCollector.h"
+#include "Profiler.h"
+#include "SourceFile.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QtEndian>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <thread>
+#ifdef HASHTRACE_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace {
+
+enum class ArchiveType { None, Zip, Tar, TarGz };
+
+ArchiveType archiveType(const QString &path)
+{
+    const QString name = QFileInfo(path).fileName().toLower();
+    if (name.endsWith(".zip")) return ArchiveType::Zip;
+    if (name.endsWith(".tar")) return ArchiveType::Tar;
+    if (name.endsWith(".tar.gz") || name.endsWith(".tgz")) return ArchiveType::TarGz;
+    return ArchiveType::None;
+}
+
+// Archives come from untrusted uploads; nothing is inflated past this,
+// per zip entry or per compressed tar
+constexpr qsizetype MAX_UNPACKED_SIZE = qsizetype(512) << 20;
+
+// Calls fn(i) for every i < count, spread over up to threads threads. An
+// exception thrown by fn(i), such as std::bad_alloc, ends up in errors[i]
+// instead of terminating the process.
+void parallelFor(size_t count, int threads, const std::function<void(size_t)> &fn, std::vector<QString> &errors)
+{
+    std::atomic<size_t> next{0};
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < count) {
+            try {
+                fn(i);
+            } catch (const std::bad_alloc &) {
+                errors[i] = SubmissionCollector::tr("Out of memory while collecting files");
+            } catch (const std::exception &e) {
+                errors[i] = SubmissionCollector::tr("Failed to collect files: %1").arg(QString::fromLocal8Bit(e.what()));
+            } catch (...) {
+                errors[i] = SubmissionCollector::tr("Failed to collect files");
+            }
+        }
+    };
+
+    const size_t threadCount = std::min(count, static_cast<size_t>(std::max(1, threads)));
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threadCount; ++i) {
+        pool.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : pool) {
+        thread.join();
+    }
+}
+
+// Archive entry names end up below the scratch directory; absolute names
+// and names that climb out of it are refused
+QString safeEntryPath(QString name)
+{
+    name.replace(QLatin1Char('\\'), QLatin1Char('/'));
+    const QString cleaned = QDir::cleanPath(name);
+    if (cleaned.isEmpty() || cleaned == "." || cleaned == ".." || cleaned.startsWith("../") ||
+        cleaned.startsWith(QLatin1Char('/')) || cleaned.contains(QLatin1Char(':'))) {
+        return QString();
+    }
+    return cleaned;
+}
+
+QByteArray field(const char *data, size_t length)
+{
+    return QByteArray(data, static_cast<qsizetype>(strnlen(data, length)));
+}
+
+#ifdef HASHTRACE_HAVE_ZLIB
+enum class Inflated { Ok, Corrupt, TooLarge };
+
+// windowBits selects the format: -MAX_WBITS for raw deflate (zip),
+// 16 + MAX_WBITS for gzip. More than limit bytes of output fail with
+// TooLarge; the buffer only grows as output arrives, so a size claimed
+// by a header costs nothing up front.
+Inflated inflateData(QByteArrayView data, int windowBits, qsizetype limit, QByteArray &out)
+{
+    z_stream stream{};
+    if (inflateInit2(&stream, windowBits) != Z_OK) {
+        return Inflated::Corrupt;
+    }
+    // One byte past the limit tells an exact fit from an overflow
+    const qsizetype capacity = limit + 1;
+    out.resize(std::min(capacity, std::max<qsizetype>(data.size() * 4, 4096)));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+
+    int status = Z_OK;
+    while (status == Z_OK) {
+        const auto produced = static_cast<qsizetype>(stream.total_out);
+        if (produced > limit) {
+            break;
+        }
+        if (produced == out.size()) {
+            out.resize(std::min(capacity, out.size() * 2));
+        }
+        stream.next_out = reinterpret_cast<Bytef *>(out.data()) + produced;
+        stream.avail_out = static_cast<uInt>(out.size() - produced);
+        status = inflate(&stream, Z_NO_FLUSH);
+    }
+    const auto produced = static_cast<qsizetype>(stream.total_out);
+    inflateEnd(&stream);
+    if (produced > limit) {
+        out.clear();
+        return Inflated::TooLarge;
+    }
+    out.resize(produced);
+    return status == Z_STREAM_END ? Inflated::Ok : Inflated::Corrupt;
+}
+#endif
+
+// Writes the wanted entries of one archive below a directory
+class ArchiveUnpacker {
+    Q_DECLARE_TR_FUNCTIONS(SubmissionCollector)
+
+public:
+    ArchiveUnpacker(const QString &destination, std::function<bool(const QString &)> wanted)
+        : m_destination(destination), m_wanted(std::move(wanted))
+    {
+    }
+
+    bool unpack(const QString &archivePath, ArchiveType type)
+    {
+        SourceFile archive;
+        if (!archive.open(archivePath)) {
+            m_error = tr("Failed to open archive %1: %2").arg(archivePath, archive.errorString());
+            return false;
+        }
+        m_archive = archivePath;
+
+        switch (type) {
+        case ArchiveType::Zip:
+            return readZip(archive.bytes());
+        case ArchiveType::Tar:
+            return readTar(archive.bytes());
+        case ArchiveType::TarGz: {
+#ifdef HASHTRACE_HAVE_ZLIB
+            QByteArray tar;
+            switch (inflateData(archive.bytes(), 16 + MAX_WBITS, MAX_UNPACKED_SIZE, tar)) {
+            case Inflated::Ok:
+                return readTar(tar);
+            case Inflated::TooLarge:
+                return fail(tr("unpacks to more than %1 MiB").arg(MAX_UNPACKED_SIZE >> 20));
+            case Inflated::Corrupt:
+                break;
+            }
+            return fail(tr("corrupt gzip data"));
+#else
+            return fail(tr("compressed tar archives need a build with zlib"));
+#endif
+        }
+        case ArchiveType::None:
+            break;
+        }
+        return fail(tr("unknown archive type"));
+    }
+
+    QStringList files;
+    QStringList warnings;
+
+    QString errorString() const
+    {
+        return m_error;
+    }
+
+private:
+    bool fail(const QString &reason)
+    {
+        m_error = tr("Failed to read archive %1: %2").arg(m_archive, reason);
+        return false;
+    }
+
+    // ustar and GNU tar; long names from 'L' records, other special
+    // entries (links, devices, pax headers) are skipped
+    bool readTar(QByteArrayView data)
+    {
+        constexpr qsizetype BLOCK = 512;
+        QString longName;
+        qsizetype pos = 0;
+        while (pos + BLOCK <= data.size()) {
+            const char *header = data.data() + pos;
+            if (std::all_of(header, header + BLOCK, [](char c) { return c == 0; })) {
+                break;
+            }
+
+            bool ok = false;
+            const QByteArray sizeField = field(header + 124, 12).trimmed();
+            const qint64 size = sizeField.isEmpty() ? 0 : sizeField.toLongLong(&ok, 8);
+            if (!sizeField.isEmpty() && !ok) {
+                return fail(tr("unsupported tar header"));
+            }
+            pos += BLOCK;
+            if (size < 0 || size > data.size() - pos) {
+                return fail(tr("truncated tar data"));
+            }
+
+            QString name = longName;
+            longName.clear();
+            if (name.isEmpty()) {
+                name = QString::fromUtf8(field(header, 100));
+                const QByteArray prefix = field(header + 345, 155);
+                if (std::memcmp(header + 257, "ustar", 5) == 0 && !prefix.isEmpty()) {
+                    name = QString::fromUtf8(prefix) + QLatin1Char('/') + name;
+                }
+            }
+
+            const QByteArrayView content = data.sliced(pos, static_cast<qsizetype>(size));
+            const char type = header[156];
+            if (type == 'L') {
+                longName = QString::fromUtf8(field(content.data(), static_cast<size_t>(size)));
+            } else if ((type == '0' || type == '\0') && !write(name, content)) {
+                return false;
+            }
+            pos += (static_cast<qsizetype>(size) + BLOCK - 1) / BLOCK * BLOCK;
+        }
+        return true;
+    }
+
+    // Stored and deflated entries of a zip file, read through the central
+    // directory; zip64 archives are not supported
+    bool readZip(QByteArrayView data)
+    {
+        const auto *bytes = reinterpret_cast<const uchar *>(data.data());
+        const qsizetype size = data.size();
+        auto u16 = [bytes](qsizetype at) { return qFromLittleEndian<quint16>(bytes + at); };
+        auto u32 = [bytes](qsizetype at) { return qFromLittleEndian<quint32>(bytes + at); };
+
+        // The end record is the last thing in the file, after a comment of
+        // up to 64 KiB
+        qsizetype end = -1;
+        for (qsizetype at = size - 22; at >= 0 && at >= size - 22 - 0xFFFF; --at) {
+            if (u32(at) == 0x06054b50) {
+                end = at;
+                break;
+            }
+        }
+        if (end < 0) {
+            return fail(tr("no zip directory found"));
+        }
+
+        const quint16 entryCount = u16(end + 10);
+        const quint32 directoryOffset = u32(end + 16);
+        if (entryCount == 0xFFFF || directoryOffset == 0xFFFFFFFF) {
+            return fail(tr("zip64 archives are not supported"));
+        }
+
+        qsizetype pos = directoryOffset;
+        for (quint16 i = 0; i < entryCount; ++i) {
+            if (pos + 46 > size || u32(pos) != 0x02014b50) {
+                return fail(tr("corrupt zip directory"));
+            }
+            const quint16 flags = u16(pos + 8);
+            const quint16 method = u16(pos + 10);
+            const quint32 compressedSize = u32(pos + 20);
+            const quint32 uncompressedSize = u32(pos + 24);
+            const quint16 nameLength = u16(pos + 28);
+            const qsizetype entryLength = 46 + nameLength + u16(pos + 30) + u16(pos + 32);
+            const quint32 localOffset = u32(pos + 42);
+            if (pos + entryLength > size) {
+                return fail(tr("corrupt zip directory"));
+            }
+            const QByteArray rawName(data.data() + pos + 46, nameLength);
+            // Bit 11 marks UTF-8 names; older tools write code page 437
+            const QString name = (flags & 0x800) ? QString::fromUtf8(rawName) : QString::fromLatin1(rawName);
+            pos += entryLength;
+
+            if (name.endsWith(QLatin1Char('/')) || !m_wanted(name)) {
+                continue;
+            }
+            if (flags & 0x1) {
+                warnings << tr("Skipping encrypted entry %1 in %2").arg(name, m_archive);
+                continue;
+            }
+
+            if (qsizetype(localOffset) + 30 > size || u32(localOffset) != 0x04034b50) {
+                return fail(tr("corrupt zip entry %1").arg(name));
+            }
+            const qsizetype dataStart = qsizetype(localOffset) + 30 + u16(localOffset + 26) + u16(localOffset + 28);
+            if (dataStart + qsizetype(compressedSize) > size) {
+                return fail(tr("truncated zip entry %1").arg(name));
+            }
+            const QByteArrayView content = data.sliced(dataStart, compressedSize);
+
+            if (method == 0) {
+                if (!write(name, content)) return false;
+            } else if (method == 8) {
+#ifdef HASHTRACE_HAVE_ZLIB
+                if (qsizetype(uncompressedSize) > MAX_UNPACKED_SIZE) {
+                    warnings << tr("Skipping entry %1 in %2, it is larger than %3 MiB")
+                                    .arg(name, m_archive).arg(MAX_UNPACKED_SIZE >> 20);
+                    continue;
+                }
+                // The declared size is a bound, not a promise
+                QByteArray inflated;
+                const Inflated status = inflateData(content, -MAX_WBITS, uncompressedSize, inflated);
+                if (status == Inflated::Corrupt) {
+                    return fail(tr("corrupt zip entry %1").arg(name));
+                }
+                if (status == Inflated::TooLarge || inflated.size() != qsizetype(uncompressedSize)) {
+                    return fail(tr("zip entry %1 does not match its declared size").arg(name));
+                }
+                if (!write(name, inflated)) return false;
+#else
+                Q_UNUSED(uncompressedSize);
+                warnings << tr("Skipping compressed entry %1 in %2, this build has no zlib").arg(name, m_archive);
+#endif
+            } else {
+                warnings << tr("Skipping entry %1 in %2, compression method %3 is not supported")
+                                .arg(name).arg(m_archive).arg(method);
+            }
+        }
+        return true;
+    }
+
+    bool write(const QString &name, QByteArrayView content)
+    {
+        const QString entryPath = safeEntryPath(name);
+        if (entryPath.isEmpty()) {
+            warnings << tr("Skipping entry %1 in %2, its path leaves the archive").arg(name, m_archive);
+            return true;
+        }
+        if (!m_wanted(entryPath)) {
+            return true;
+        }
+
+        const QString path = m_destination + QLatin1Char('/') + entryPath;
+        QDir().mkpath(QFileInfo(path).path());
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly) || file.write(content.data(), content.size()) != content.size()) {
+            m_error = tr("Failed to unpack %1: %2").arg(path, file.errorString());
+            return false;
+        }
+        files << path;
+        return true;
+    }
+
+    QString m_destination;
+    std::function<bool(const QString &)> m_wanted;
+    QString m_archive;
+    QString m_error;
+};
+
+}
+
+SubmissionCollector::SubmissionCollector(const Options &options) : m_options(options)
+{
+    if (m_options.threads <= 0) {
+        m_options.threads = qMax(1, QThread::idealThreadCount());
+    }
+    for (auto &extension : m_options.extensions) {
+        extension = extension.trimmed().toLower();
+        if (extension.startsWith(QLatin1Char('.'))) {
+            extension.remove(0, 1);
+        }
+    }
+}
+
+QStringList SubmissionCollector::defaultExtensions()
+{
+    return {"c", "cc", "cpp", "cxx", "h", "hh", "hpp", "hxx", "java", "py", "js", "ts", "cs", "go", "rs",
+            "kt", "swift"};
+}
+
+bool SubmissionCollector::isArchive(const QString &path)
+{
+    return archiveType(path) != ArchiveType::None;
+}
+
+QStringList SubmissionCollector::files() const
+{
+    return m_files;
+}
+
+std::vector<SubmissionCollector::Duplicate> SubmissionCollector::duplicates() const
+{
+    return m_duplicates;
+}
+
+QStringList SubmissionCollector::warnings() const
+{
+    return m_warnings;
+}
+
+QString SubmissionCollector::errorString() const
+{
+    return m_error;
+}
+
+void SubmissionCollector::setCancellationToken(const CancellationToken *token)
+{
+    m_cancellation = token;
+}
+
+QString SubmissionCollector::scratchPath()
+{
+    if (!m_scratch) {
+        m_scratch = std::make_unique<QTemporaryDir>();
+    }
+    return m_scratch->isValid() ? m_scratch->path() : QString();
+}
+
+bool SubmissionCollector::collect(const QStringList &paths)
+{
+    m_files.clear();
+    m_duplicates.clear();
+    m_warnings.clear();
+    m_error.clear();
+    Profiler::Scope scope(Profiler::Collect);
+
+    const QSet<QString> extensions(m_options.extensions.begin(), m_options.extensions.end());
+    auto wanted = [&extensions](const QString &name) {
+        return extensions.isEmpty() || extensions.contains(QFileInfo(name).suffix().toLower());
+    };
+
+    // Every input becomes a run of files; an archive's run is filled in
+    // once it is unpacked
+    struct Archive {
+        QString path;
+        ArchiveType type;
+        size_t run;
+    };
+    std::vector<QStringList> runs;
+    std::vector<Archive> archives;
+    auto addArchive = [&](const QString &path, ArchiveType type) {
+        archives.push_back({path, type, runs.size()});
+        runs.emplace_back();
+    };
+
+    for (const QString &path : paths) {
+        const QFileInfo info(path);
+        if (info.isDir()) {
+            QStringList found;
+            QDirIterator it(path, QDir::Files | QDir::Readable, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                found << it.next();
+            }
+            std::sort(found.begin(), found.end());
+
+            QStringList sources;
+            for (const QString &file : found) {
+                const ArchiveType type = archiveType(file);
+                if (type != ArchiveType::None) {
+                    runs.push_back(sources);
+                    sources.clear();
+                    addArchive(file, type);
+                } else if (wanted(file)) {
+                    sources << file;
+                }
+            }
+            runs.push_back(sources);
+        } else if (info.isFile()) {
+            const ArchiveType type = archiveType(path);
+            if (type != ArchiveType::None) {
+                addArchive(path, type);
+            } else {
+                runs.push_back({path});
+            }
+        } else {
+            m_error = tr("No such file or directory: %1").arg(path);
+            return false;
+        }
+    }
+
+    // Archives are unpacked side by side, each into its own directory
+    if (!archives.empty()) {
+        const QString scratch = scratchPath();
+        if (scratch.isEmpty()) {
+            m_error = tr("Could not create a directory to unpack archives into");
+            return false;
+        }
+
+        std::vector<QString> errors(archives.size());
+        std::vector<QStringList> archiveWarnings(archives.size());
+        parallelFor(archives.size(), m_options.threads, [&](size_t i) {
+            if (m_cancellation && m_cancellation->isCancelled()) return;
+            const Archive &archive = archives[i];
+            const QString destination = QStringLiteral("%1/%2-%3").arg(scratch).arg(i).arg(QFileInfo(archive.path).fileName());
+            ArchiveUnpacker unpacker(destination, wanted);
+            if (!unpacker.unpack(archive.path, archive.type)) {
+                errors[i] = unpacker.errorString();
+            }
+            std::sort(unpacker.files.begin(), unpacker.files.end());
+            runs[archive.run] = unpacker.files;
+            archiveWarnings[i] = unpacker.warnings;
+        }, errors);
+        if (m_cancellation) {
+            m_cancellation->throwIfCancelled();
+        }
+        for (size_t i = 0; i < archives.size(); ++i) {
+            m_warnings << archiveWarnings[i];
+            if (!errors[i].isEmpty()) {
+                m_error = errors[i];
+                return false;
+            }
+        }
+    }
+
+    QStringList files;
+    for (const QStringList &run : runs) {
+        files << run;
+    }
+
+    // Hash the raw bytes; an empty hash marks an empty file
+    std::vector<QByteArray> hashes(static_cast<size_t>(files.size()));
+    std::vector<QString> errors(hashes.size());
+    parallelFor(hashes.size(), m_options.threads, [&](size_t i) {
+        if (m_cancellation && m_cancellation->isCancelled()) return;
+        SourceFile source;
+        if (!source.open(files[static_cast<qsizetype>(i)])) {
+            errors[i] = tr("Failed to open file: %1").arg(files[static_cast<qsizetype>(i)]);
+        } else if (!source.bytes().isEmpty()) {
+            hashes[i] = QCryptographicHash::hash(source.bytes(), QCryptographicHash::Blake2b_128);
+        }
+    }, errors);
+    if (m_cancellation) {
+        m_cancellation->throwIfCancelled();
+    }
+
+    // The first file with some content is kept, later copies point to it
+    QHash<QByteArray, qsizetype> firstWithHash;
+    for (qsizetype i = 0; i < files.size(); ++i) {
+        const size_t slot = static_cast<size_t>(i);
+        if (!errors[slot].isEmpty()) {
+            m_error = errors[slot];
+            return false;
+        }
+        if (hashes[slot].isEmpty()) {
+            m_warnings << tr("Skipping empty file: %1").arg(files[i]);
+            continue;
+        }
+        auto first = firstWithHash.constFind(hashes[slot]);
+        if (first != firstWithHash.constEnd()) {
+            m_duplicates.push_back({files[i], files[*first]});
+        } else {
+            firstWithHash.insert(hashes[slot], i);
+            m_files << files[i];
+        }
+    }
+    Profiler::add(Profiler::FilesCollected, static_cast<uint64_t>(files.size()));
+    Profiler::add(Profiler::DuplicateFiles, m_duplicates.size());
+    return true;
+}
@@ -0,0 +1,74 @@
+#ifndef SUBMISSION_COLLECTOR_H
+#define SUBMISSION_COLLECTOR_H
+
+#include <QCoreApplication>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryDir>
+#include "Cancellation.h"
+#include <memory>
+#include <vector>
+
+// Turns the inputs of a run into the source files to compare. Directories
+// are walked recursively and archives (.zip and .tar, and .tar.gz/.tgz when
+// built with zlib) are unpacked into a scratch directory that lives as long
+// as the collector. Files named directly are always kept; files found in
+// directories and archives only when their extension is in the filter.
+//
+// The raw bytes of all files are then hashed on several threads and
+// byte-identical files are collapsed before anything is preprocessed: the
+// first file of each group is kept, the others are reported as duplicates
+// of it and need no further work.
+class SubmissionCollector {
+    Q_DECLARE_TR_FUNCTIONS(SubmissionCollector)
+
+public:
+    struct Options {
+        QStringList extensions = defaultExtensions();  // without the dot; empty keeps every file
+        int threads = 0;                               // 0 uses QThread::idealThreadCount()
+    };
+
+    struct Duplicate {
+        QString file;
+        QString original;  // the kept file with the same content
+    };
+
+    explicit SubmissionCollector(const Options &options = Options());
+
+    SubmissionCollector(const SubmissionCollector &) = delete;
+    SubmissionCollector &operator=(const SubmissionCollector &) = delete;
+
+    static QStringList defaultExtensions();
+    // Whether collect() unpacks path as an archive, judged by its name
+    static bool isArchive(const QString &path);
+
+    // Expands paths (local files, directories or archives). Directory
+    // contents are taken in sorted order, so the result does not depend on
+    // enumeration order. Empty files are skipped with a warning. Stops at
+    // the first error and returns false; errorString() then describes it.
+    // Throws OperationCancelled when the cancellation token fires.
+    bool collect(const QStringList &paths);
+
+    // Files to compare, one per distinct content, in input order
+    QStringList files() const;
+    std::vector<Duplicate> duplicates() const;
+    QStringList warnings() const;
+    QString errorString() const;
+
+    // Polled before every archive and every hashed file. The token must
+    // outlive the collector.
+    void setCancellationToken(const CancellationToken *token);
+
+private:
+    QString scratchPath();
+
+    Options m_options;
+    const CancellationToken *m_cancellation = nullptr;
+    std::unique_ptr<QTemporaryDir> m_scratch;
+    QStringList m_files;
+    std::vector<Duplicate> m_duplicates;
+    QStringList m_warnings;
+    QString m_error;
+};
+
+#endif // SUBMISSION_COLLECTOR_H
@@ -0,0 +1,146 @@
+#include "WorkStealingPool.h"
+#include <algorithm>
+
+namespace {
+// Pool and queue index of the worker running on the current thread
+thread_local const WorkStealingPool *currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+}
+
+WorkStealingPool::WorkStealingPool(size_t threads)
+{
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+        m_queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        m_threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    for (auto &thread : m_threads) {
+        thread.join();
+    }
+}
+
+size_t WorkStealingPool::threadCount() const
+{
+    return m_threads.size();
+}
+
+void WorkStealingPool::submit(std::function<void()> task)
+{
+    size_t index;
+    if (currentPool == this) {
+        index = currentWorker;
+    } else {
+        index = m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        {
+            std::lock_guard<std::mutex> queueLock(m_queues[index]->mutex);
+            m_queues[index]->tasks.push_back(std::move(task));
+        }
+        m_queued++;
+        m_pending++;
+    }
+    m_wake.notify_one();
+}
+
+void WorkStealingPool::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle.wait(lock, [this] { return m_pending == 0; });
+
+    if (m_error) {
+        std::exception_ptr error = m_error;
+        m_error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+bool WorkStealingPool::takeTask(size_t index, std::function<void()> &task)
+{
+    // Newest task of our own deque keeps the working set warm
+    {
+        auto &own = *m_queues[index];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Steal the oldest task, which tends to be the largest remaining chunk
+    for (size_t offset = 1; offset < m_queues.size(); ++offset) {
+        auto &victim = *m_queues[(index + offset) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void WorkStealingPool::runTask(std::function<void()> &task)
+{
+    std::exception_ptr error;
+    try {
+        task();
+    } catch (...) {
+        error = std::current_exception();
+    }
+    task = nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (error && !m_error) {
+        m_error = error;
+    }
+    if (--m_pending == 0) {
+        m_idle.notify_all();
+    }
+}
+
+void WorkStealingPool::workerLoop(size_t index)
+{
+    currentPool = this;
+    currentWorker = index;
+
+    std::function<void()> task;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wake.wait(lock, [this] { return m_stopping || m_queued > 0; });
+            if (m_stopping && m_queued == 0) {
+                return;
+            }
+            // Claim a task while still holding the lock, so other workers
+            // go back to sleep instead of racing for it
+            m_queued--;
+        }
+
+        // The deques hold at least as many tasks as there are claims; a
+        // scan only misses when a submit and a steal overlap with it
+        while (!takeTask(index, task)) {
+            std::this_thread::yield();
+        }
+        runTask(task);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size thread pool where every worker owns a task deque. Workers take
+// their own newest task first and steal the oldest task of another worker
+// when they run dry, which keeps all threads busy when task costs vary.
+class WorkStealingPool {
+public:
+    // threads == 0 uses the hardware concurrency
+    explicit WorkStealingPool(size_t threads = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // Tasks submitted from a worker go to that worker's own deque
+    void submit(std::function<void()> task);
+
+    // Blocks until every submitted task has finished; rethrows the first
+    // exception thrown by a task
+    void wait();
+
+    size_t threadCount() const;
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void workerLoop(size_t index);
+    bool takeTask(size_t index, std::function<void()> &task);
+    void runTask(std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_idle;
+    size_t m_queued = 0;   // guarded by m_mutex
+    size_t m_pending = 0;  // queued or running, guarded by m_mutex
+    bool m_stopping = false;
+    std::exception_ptr m_error;
+
+    std::atomic<size_t> m_nextQueue{0};
+};
+
+#endif // WORK_STEALING_POOL_H
@@ -1,25 +1,355 @@
 #include "backend.h"
 #include "Rabin_karp.h"
 #include "Preprocessor.h"
+#include "ComparisonEngine.h"
+#include "SourceFile.h"
+#include "LoadPipeline.h"
+#include "OffsetMap.h"
+#include "SubmissionCollector.h"
+#include "Profiler.h"
+#include <QDir>
+#include <QDirIterator>
 #include <QFile>
-#include <QTextStream>
 #include <QtConcurrent/QtConcurrentRun>
 #include <QDebug>
 #include <QUrl>
 #include <QFileInfo>
+#include <QThread>
+#include <QStandardPaths>
+#include <algorithm>
 
-Backend::Backend(QObject *parent) : QObject(parent)
+namespace {
+// k-gram length used for fingerprinting the preprocessed text
+constexpr int KGRAM_SIZE = 5;
+// Winnowing window; matches of at least WINNOW_WINDOW + KGRAM_SIZE - 1
+// characters are always detected
+constexpr int WINNOW_WINDOW = 4;
+// Match runs are extended over the whole common text, so every copied
+// stretch the winnowing guarantee covers reaches this length; shorter
+// ones are only found by chance and are dropped. Hashes repeated more often than
+// MAX_POSTINGS times (boilerplate) are not used to seed runs.
+constexpr size_t MIN_RUN_LENGTH = WINNOW_WINDOW + KGRAM_SIZE - 1;
+constexpr size_t MAX_POSTINGS = 64;
+// Progress updates from the workers are forwarded at most this often
+constexpr qint64 PROGRESS_INTERVAL_MS = 100;
+// Editors often write a file in several steps; changes are collected for
+// this long before the changed files are compared again
+constexpr int CHANGE_DELAY_MS = 300;
+
+// Match runs of one pair with their ranges in the displayed files
+struct MatchDetail {
+    std::vector<RabinKarp::MatchRun> runs;
+    std::vector<OffsetMap::Range> ranges1;
+    std::vector<OffsetMap::Range> ranges2;
+    QString error;
+};
+
+QString localPathOf(const QString &path)
+{
+    return path.startsWith("file:///") ? QUrl(path).toLocalFile() : path;
+}
+
+// Entries of a directory that a run would collect: subdirectories,
+// archives and source files. Editors' temporary files are not among them.
+QStringList collectedEntries(const QString &directory)
 {
+    static const QStringList extensions = SubmissionCollector::defaultExtensions();
+    QStringList entries;
+    const QFileInfoList infos = QDir(directory).entryInfoList(QDir::Dirs | QDir::Files | QDir::NoDotAndDotDot,
+                                                              QDir::Name);
+    for (const QFileInfo &info : infos) {
+        if (info.isDir() || SubmissionCollector::isArchive(info.filePath()) ||
+            extensions.contains(info.suffix().toLower())) {
+            entries << info.fileName();
+        }
+    }
+    return entries;
+}
+
+// Rereads a file and builds the offset map of its processed text or token
+// stream. Fails when the file no longer gives the content that was compared.
+bool mapFile(const QString &path, const FileContent &content, SourceFile &source, OffsetMap &map)
+{
+    if (!source.open(localPathOf(path))) {
+        return false;
+    }
+    Preprocessor preprocessor;
+    if (!content.tokens.empty()) {
+        return preprocessor.tokenize(source.text(), &map) == content.tokens;
+    }
+    std::string processed;
+    preprocessor.preprocess(source.text(), processed, &map);
+    return processed == content.processedContent;
+}
+
+// Translates processed ranges into ranges of the text the viewer shows
+std::vector<OffsetMap::Range> displayRanges(const SourceFile &source, const OffsetMap &map,
+                                            const std::vector<std::pair<size_t, size_t>> &processed)
+{
+    std::vector<OffsetMap::Range> ranges;
+    ranges.reserve(processed.size());
+    std::vector<size_t> offsets;
+    offsets.reserve(processed.size() * 2);
+    for (const auto &[start, length] : processed) {
+        ranges.push_back(map.toOriginal(start, length));
+        offsets.push_back(ranges.back().begin);
+        offsets.push_back(ranges.back().end);
+    }
+
+    std::sort(offsets.begin(), offsets.end());
+    offsets.erase(std::unique(offsets.begin(), offsets.end()), offsets.end());
+    std::vector<size_t> positions = offsets;
+    source.toDisplayOffsets(positions);
+
+    auto display = [&](size_t offset) {
+        return positions[static_cast<size_t>(std::lower_bound(offsets.begin(), offsets.end(), offset) -
+                                             offsets.begin())];
+    };
+    for (auto &range : ranges) {
+        range = {display(range.begin), display(range.end)};
+    }
+    return ranges;
+}
+}
+
+Backend::Backend(QObject *parent) : QObject(parent), m_results(this)
+{
+    // Everything that changes the stored fingerprints goes into the tag
+    const QByteArray configTag = QStringLiteral("k=%1;window=%2;mod=%3;base=%4;preprocessor=%5")
+                                     .arg(KGRAM_SIZE)
+                                     .arg(WINNOW_WINDOW)
+                                     .arg(RabinKarp::MOD)
+                                     .arg(RabinKarp::BASE)
+                                     .arg(Preprocessor::VERSION)
+                                     .toUtf8();
+    const QString storePath = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) +
+                              QStringLiteral("/fingerprints.store");
+    m_store = std::make_unique<FingerprintStore>(storePath, configTag);
+
+    m_progressClock.start();
+
     connect(&m_watcher, &QFutureWatcher<void>::finished, this, [this]() {
         setProcessing(false);
+        // Rows still queued in the model show up with the end of the run
+        m_results.flush();
+        // The files of a run are only known once it has collected them
+        updateWatchedFiles();
+        if (m_profiling) {
+            std::string error;
+            if (!m_traceFile.isEmpty() && !Profiler::writeTrace(localPathOf(m_traceFile).toStdString(), &error)) {
+                emit errorOccurred(tr("Could not write the trace: %1").arg(QString::fromStdString(error)));
+            }
+            emit statsChanged();
+        }
+    });
+
+    m_changeTimer.setSingleShot(true);
+    m_changeTimer.setInterval(CHANGE_DELAY_MS);
+    connect(&m_changeTimer, &QTimer::timeout, this, &Backend::compareChangedFiles);
+    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged, this, [this](const QString &localPath) {
+        m_changedFiles.insert(localPath);
+        m_changeTimer.start();
+    });
+    connect(&m_fileWatcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString &localPath) {
+        auto watched = m_watchedDirectories.constFind(localPath);
+        if (watched != m_watchedDirectories.constEnd() && collectedEntries(localPath) == *watched) {
+            return;
+        }
+        m_changedFiles.insert(localPath);
+        m_changeTimer.start();
     });
 }
 
+Backend::~Backend()
+{
+    if (m_watcher.isRunning()) {
+        m_cancellation->cancel();
+        m_watcher.waitForFinished();
+    }
+    m_store->save();
+}
+
 bool Backend::isProcessing() const
 {
     return m_isProcessing;
 }
 
+bool Backend::tokenMode() const
+{
+    return m_tokenMode;
+}
+
+void Backend::setTokenMode(bool tokenMode)
+{
+    if (m_tokenMode != tokenMode) {
+        m_tokenMode = tokenMode;
+        emit tokenModeChanged(tokenMode);
+    }
+}
+
+bool Backend::candidateFilter() const
+{
+    return m_candidateFilter;
+}
+
+void Backend::setCandidateFilter(bool enabled)
+{
+    if (m_candidateFilter != enabled) {
+        m_candidateFilter = enabled;
+        emit candidateFilterChanged(enabled);
+    }
+}
+
+int Backend::lshBands() const
+{
+    return m_lshBands;
+}
+
+void Backend::setLshBands(int bands)
+{
+    bands = qMax(1, bands);
+    if (m_lshBands != bands) {
+        m_lshBands = bands;
+        emit lshBandsChanged(bands);
+    }
+}
+
+int Backend::lshRows() const
+{
+    return m_lshRows;
+}
+
+void Backend::setLshRows(int rows)
+{
+    rows = qMax(1, rows);
+    if (m_lshRows != rows) {
+        m_lshRows = rows;
+        emit lshRowsChanged(rows);
+    }
+}
+
+double Backend::candidateThreshold() const
+{
+    return m_candidateThreshold;
+}
+
+void Backend::setCandidateThreshold(double threshold)
+{
+    threshold = qBound(0.0, threshold, 1.0);
+    if (m_candidateThreshold != threshold) {
+        m_candidateThreshold = threshold;
+        emit candidateThresholdChanged(threshold);
+    }
+}
+
+double Backend::minSimilarity() const
+{
+    return m_minSimilarity;
+}
+
+void Backend::setMinSimilarity(double similarity)
+{
+    similarity = qBound(0.0, similarity, 1.0);
+    if (m_minSimilarity != similarity) {
+        m_minSimilarity = similarity;
+        emit minSimilarityChanged(similarity);
+    }
+}
+
+int Backend::topPairs() const
+{
+    return m_topPairs;
+}
+
+void Backend::setTopPairs(int count)
+{
+    count = qMax(0, count);
+    if (m_topPairs != count) {
+        m_topPairs = count;
+        emit topPairsChanged(count);
+    }
+}
+
+bool Backend::watchFiles() const
+{
+    return m_watchFiles;
+}
+
+void Backend::setWatchFiles(bool watch)
+{
+    if (m_watchFiles != watch) {
+        m_watchFiles = watch;
+        updateWatchedFiles();
+        emit watchFilesChanged(watch);
+    }
+}
+
+QStringList Backend::baseFiles() const
+{
+    return m_baseFiles;
+}
+
+void Backend::setBaseFiles(const QStringList &files)
+{
+    if (m_baseFiles != files) {
+        m_baseFiles = files;
+        emit baseFilesChanged(files);
+    }
+}
+
+bool Backend::profiling() const
+{
+    return m_profiling;
+}
+
+void Backend::setProfiling(bool profiling)
+{
+    if (m_profiling != profiling) {
+        m_profiling = profiling;
+        Profiler::setEnabled(profiling);
+        Profiler::setTracing(profiling && !m_traceFile.isEmpty());
+        emit profilingChanged(profiling);
+    }
+}
+
+QString Backend::traceFile() const
+{
+    return m_traceFile;
+}
+
+void Backend::setTraceFile(const QString &path)
+{
+    if (m_traceFile != path) {
+        m_traceFile = path;
+        Profiler::setTracing(m_profiling && !path.isEmpty());
+        emit traceFileChanged(path);
+    }
+}
+
+QVariantMap Backend::stats() const
+{
+    const Profiler::Snapshot snapshot = Profiler::snapshot();
+    QVariantMap stages;
+    for (int i = 0; i < Profiler::StageCount; ++i) {
+        const auto &stage = snapshot.stages[static_cast<size_t>(i)];
+        stages.insert(QString::fromLatin1(Profiler::stageName(static_cast<Profiler::Stage>(i))),
+                      QVariantMap{{QStringLiteral("calls"), static_cast<qulonglong>(stage.calls)},
+                                  {QStringLiteral("ms"), stage.nanoseconds / 1e6}});
+    }
+    QVariantMap counters;
+    for (int i = 0; i < Profiler::CounterCount; ++i) {
+        counters.insert(QString::fromLatin1(Profiler::counterName(static_cast<Profiler::Counter>(i))),
+                        static_cast<qulonglong>(snapshot.counters[static_cast<size_t>(i)]));
+    }
+    return {{QStringLiteral("stages"), stages}, {QStringLiteral("counters"), counters}};
+}
+
+void Backend::resetStats()
+{
+    Profiler::reset();
+    emit statsChanged();
+}
+
 void Backend::setProcessing(bool processing)
 {
     if (m_isProcessing != processing) {
@@ -28,6 +358,77 @@ void Backend::setProcessing(bool processing)
     }
 }
 
+qint64 Backend::progressDone() const
+{
+    return m_progressDone;
+}
+
+qint64 Backend::progressTotal() const
+{
+    return m_progressTotal;
+}
+
+QString Backend::progressStage() const
+{
+    return m_progressStage;
+}
+
+int Backend::progressEta() const
+{
+    return m_progressEta;
+}
+
+ResultModel *Backend::results()
+{
+    return &m_results;
+}
+
+void Backend::setProgress(qint64 done, qint64 total, const QString &stage, int eta)
+{
+    // Updates posted by different workers can arrive slightly out of order
+    if (stage == m_progressStage && total == m_progressTotal && done < m_progressDone) {
+        return;
+    }
+
+    m_progressDone = done;
+    m_progressTotal = total;
+    m_progressStage = stage;
+    m_progressEta = eta;
+    emit progress(done, total, stage);
+    emit progressChanged();
+}
+
+void Backend::beginStage()
+{
+    const qint64 now = m_progressClock.elapsed();
+    m_stageStart = now;
+    m_lastProgress = now - PROGRESS_INTERVAL_MS;
+}
+
+void Backend::reportProgress(qint64 done, qint64 total, const QString &stage)
+{
+    // Called from worker threads: one update per interval gets through,
+    // plus the last one of the stage
+    const qint64 now = m_progressClock.elapsed();
+    if (done < total) {
+        qint64 last = m_lastProgress;
+        if (now - last < PROGRESS_INTERVAL_MS || !m_lastProgress.compare_exchange_strong(last, now)) {
+            return;
+        }
+    }
+
+    // Extrapolate from the rate of the stage so far
+    int eta = -1;
+    const qint64 elapsed = now - m_stageStart;
+    if (done > 0 && elapsed > 0) {
+        eta = qRound(static_cast<double>(elapsed) * (total - done) / done / 1000.0);
+    }
+
+    QMetaObject::invokeMethod(this, [this, done, total, stage, eta]() {
+        setProgress(done, total, stage, eta);
+    }, Qt::QueuedConnection);
+}
+
 QString Backend::getProcessedContent(const QString &filePath)
 {
     // Check cache first
@@ -35,6 +436,17 @@ QString Backend::getProcessedContent(const QString &filePath)
         return m_processedCache[filePath];
     }
 
+    // Files loaded for comparison are only converted when the UI asks
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        auto cached = m_fileCache.constFind(filePath);
+        if (cached != m_fileCache.constEnd()) {
+            QString content = QString::fromStdString(cached->file.processedContent);
+            m_processedCache[filePath] = content;
+            return content;
+        }
+    }
+
     // Load and process the file
     QString content = loadAndPreprocess(filePath);
     if (!content.isEmpty()) {
@@ -45,12 +457,12 @@ QString Backend::getProcessedContent(const QString &filePath)
 
 void Backend::processFiles(const QStringList &filePaths)
 {
-    if (filePaths.size() < 2) {
+    if (filePaths.isEmpty()) {
         emit errorOccurred(tr("Please select at least two files"));
         return;
     }
 
-    // Validate all files exist
+    // Validate all files and directories exist
     for (const auto &path : filePaths) {
         QString localPath = path;
         if (path.startsWith("file:///")) {
@@ -63,60 +475,51 @@ void Backend::processFiles(const QStringList &filePaths)
         }
     }
 
+    if (m_watcher.isRunning()) {
+        emit errorOccurred(tr("A comparison is already running"));
+        return;
+    }
+
     setProcessing(true);
+    setProgress(0, 0, QString(), -1);
+    m_results.clear();
+    // The files may have changed since the details were computed
+    m_detailCache.clear();
+    m_pendingDetails.clear();
+    ++m_detailGeneration;
     m_loadedFiles.clear();
+    m_resultsComplete = false;
 
-    QFuture<void> future = QtConcurrent::run([this, filePaths]() {
-        try {
-            for (const auto &path : filePaths) {
-                FileContent fc;
-                fc.path = path;
-
-                // Load original content
-                QString localPath = path;
-                if (path.startsWith("file:///")) {
-                    localPath = QUrl(path).toLocalFile();
-                }
-
-                QFile file(localPath);
-                if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-                    emit errorOccurred(tr("Failed to open file: %1").arg(localPath));
-                    return;
-                }
-
-                QTextStream in(&file);
-                in.setAutoDetectUnicode(true);
-                fc.content = in.readAll();
-                file.close();
-
-                if (fc.content.isEmpty()) {
-                    emit errorOccurred(tr("File is empty: %1").arg(localPath));
-                    return;
-                }
-
-                // Process content
-                try {
-                    Preprocessor preprocessor;
-                    std::string stdContent = fc.content.toStdString();
-                    std::string processed = preprocessor.preprocess(stdContent);
-                    fc.processedContent = QString::fromStdString(processed);
-
-                    if (fc.processedContent.isEmpty()) {
-                        emit errorOccurred(tr("Failed to process file: %1").arg(localPath));
-                        return;
-                    }
-                } catch (const std::exception &e) {
-                    emit errorOccurred(tr("Preprocessing error for %1: %2").arg(localPath, e.what()));
-                    return;
-                }
-
-                m_loadedFiles.append(fc);
-
-                // Cache the processed content
-                m_processedCache[path] = fc.processedContent;
-            }
+    const bool tokenMode = m_tokenMode;
+    m_inputPaths = filePaths;
+    m_loadedPaths.clear();
+    m_loadedTokenMode = tokenMode;
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        m_duplicateOf.clear();
+        m_copiesOf.clear();
+    }
+    m_changedFiles.clear();
+    updateWatchedFiles();
+
+    const QStringList baseFiles = m_baseFiles;
+    const ComparisonEngine::Options options = comparisonOptions();
+    const ComparisonEngine::Query query = comparisonQuery();
+    startJob([this, filePaths, baseFiles, tokenMode, options, query](const CancellationToken &cancellation) {
+        loadAndCompare(filePaths, baseFiles, tokenMode, options, query, cancellation);
+    });
+}
+
+void Backend::startJob(std::function<void(const CancellationToken &)> job)
+{
+    auto cancellation = std::make_shared<CancellationToken>();
+    m_cancellation = cancellation;
 
-            compareAllFiles();
+    QFuture<void> future = QtConcurrent::run([this, job = std::move(job), cancellation]() {
+        try {
+            job(*cancellation);
+        } catch (const OperationCancelled &) {
+            // Already reported by cancelProcessing()
         } catch (const std::exception &e) {
             emit errorOccurred(tr("Processing error: %1").arg(e.what()));
         } catch (...) {
@@ -134,26 +537,21 @@ QString Backend::loadAndPreprocess(const QString &filePath)
         localPath = QUrl(filePath).toLocalFile();
     }
 
-    QFile file(localPath);
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    SourceFile source;
+    if (!source.open(localPath)) {
         qWarning() << "Could not open file:" << localPath;
         return "";
     }
 
-    QTextStream in(&file);
-    in.setAutoDetectUnicode(true);
-    QString content = in.readAll();
-    file.close();
-
-    if (content.isEmpty()) {
+    if (source.text().empty()) {
         qWarning() << "Empty file:" << localPath;
         return "";
     }
 
     try {
         Preprocessor preprocessor;
-        std::string stdContent = content.toStdString();
-        std::string processed = preprocessor.preprocess(stdContent);
+        std::string processed;
+        preprocessor.preprocess(source.text(), processed);
         return QString::fromStdString(processed);
     } catch (const std::exception &e) {
         qWarning() << "Preprocessing error:" << e.what();
@@ -161,80 +559,599 @@ QString Backend::loadAndPreprocess(const QString &filePath)
     }
 }
 
-void Backend::compareAllFiles()
+void Backend::loadAndCompare(const QStringList &inputPaths, const QStringList &baseFiles, bool tokenMode,
+                             const ComparisonEngine::Options &options, const ComparisonEngine::Query &query,
+                             const CancellationToken &cancellation)
 {
-    if (m_loadedFiles.size() < 2) {
-        emit errorOccurred(tr("Not enough files loaded for comparison"));
+    // Expand directories and archives and collapse byte-identical files
+    // before anything is preprocessed
+    reportProgress(0, 0, tr("Collecting files"));
+    QStringList inputs;
+    for (const QString &path : inputPaths) {
+        inputs << localPathOf(path);
+    }
+    auto collector = std::make_unique<SubmissionCollector>();
+    collector->setCancellationToken(&cancellation);
+    const bool collected = collector->collect(inputs);
+    for (const QString &warning : collector->warnings()) {
+        qWarning() << warning;
+    }
+    if (!collected) {
+        emit errorOccurred(collector->errorString());
         return;
     }
+    const QStringList filePaths = collector->files();
+    const std::vector<SubmissionCollector::Duplicate> duplicates = collector->duplicates();
+    if (filePaths.size() + static_cast<int>(duplicates.size()) < 2) {
+        emit errorOccurred(tr("Please select at least two files"));
+        return;
+    }
+    // Keeps the unpacked archives on disk for the detail view
+    m_collector = std::move(collector);
+    m_loadedPaths = filePaths;
+
+    auto baseFilter = std::make_shared<BaseCodeFilter>(BaseCodeFilter::Options{KGRAM_SIZE, tokenMode});
+    for (const QString &path : baseFiles) {
+        if (!baseFilter->addFile(localPathOf(path))) {
+            emit errorOccurred(baseFilter->errorString());
+            return;
+        }
+    }
+    // Cached fingerprints were filtered with the base code of their run
+    if (!m_baseFilter || *m_baseFilter != *baseFilter) {
+        QMutexLocker locker(&m_cacheMutex);
+        m_fileCache.clear();
+    }
+    m_baseFilter = baseFilter;
 
-    RabinKarp rk;
-    QVariantList matches;
     double totalScore = 0;
     int comparisons = 0;
 
-    // Compare each pair of files using processed content
-    for (int i = 0; i < m_loadedFiles.size(); ++i) {
-        for (int j = i + 1; j < m_loadedFiles.size(); ++j) {
-            const auto &file1 = m_loadedFiles[i];
-            const auto &file2 = m_loadedFiles[j];
-
-            if (file1.processedContent.isEmpty() || file2.processedContent.isEmpty()) {
-                qWarning() << "Skipping comparison due to empty processed content";
-                continue;
+    // Identical files are reported right away and not compared again; the
+    // rows of the kept file are copied to them as they are published
+    if (!duplicates.empty()) {
+        std::vector<ResultModel::Entry> batch;
+        QMutexLocker locker(&m_cacheMutex);
+        for (const auto &duplicate : duplicates) {
+            m_duplicateOf.insert(duplicate.file, duplicate.original);
+            QStringList &copies = m_copiesOf[duplicate.original];
+            batch.push_back({duplicate.original, duplicate.file, 100.0});
+            for (const QString &copy : std::as_const(copies)) {
+                batch.push_back({copy, duplicate.file, 100.0});
             }
+            copies << duplicate.file;
+        }
+        totalScore += 100.0 * static_cast<double>(batch.size());
+        comparisons += postResults(std::move(batch));
+    }
 
-            try {
-                double similarity = rk.computeSimilarity(
-                    file1.processedContent.toStdString(),
-                    file2.processedContent.toStdString(),
-                    5 // k-gram size
-                    );
-
-                totalScore += similarity;
-                comparisons++;
-
-                QVariantMap match;
-                match["file1"] = file1.path;
-                match["file2"] = file2.path;
-                match["score"] = similarity * 100;
-
-                // Get match positions for detailed view
-                auto matchPositions = rk.findMatches(
-                    file1.processedContent.toStdString(),
-                    file2.processedContent.toStdString(),
-                    5
-                    );
-
-                QVariantList segments;
-                for (const auto &pos : matchPositions) {
-                    QVariantMap segment;
-                    segment["pos1"] = static_cast<int>(pos.first);
-                    segment["pos2"] = static_cast<int>(pos.second);
-                    segments.append(segment);
-                }
-                match["segments"] = segments;
-
-                matches.append(match);
-            } catch (const std::exception &e) {
-                qWarning() << "Comparison error:" << e.what();
-            }
+    const int fileCount = filePaths.size();
+    std::vector<FileContent> files(static_cast<size_t>(fileCount));
+    std::vector<QString> localPaths(files.size());
+    std::vector<QDateTime> modified(files.size());
+    std::vector<qint64> sizes(files.size());
+    std::vector<int> cachedFiles;
+    std::vector<int> pendingFiles;
+
+    for (int i = 0; i < fileCount; ++i) {
+        const QString &path = filePaths[i];
+        files[i].path = path;
+
+        localPaths[i] = localPathOf(path);
+
+        // Reuse the fingerprints of files that have not changed
+        QFileInfo info(localPaths[i]);
+        modified[i] = info.lastModified();
+        sizes[i] = info.size();
+        QMutexLocker locker(&m_cacheMutex);
+        auto cached = m_fileCache.constFind(path);
+        if (cached != m_fileCache.constEnd() &&
+            cached->tokenMode == tokenMode &&
+            cached->lastModified == modified[i] &&
+            cached->size == sizes[i]) {
+            files[i] = cached->file;
+            cachedFiles.push_back(i);
+        } else {
+            pendingFiles.push_back(i);
+        }
+    }
+
+    // With the candidate filter or a query the whole set is needed up
+    // front, so the comparison waits for the last file
+    const bool streaming = !options.candidateFilter && !isQuery(query);
+    ComparisonEngine engine(RabinKarp(WINNOW_WINDOW), options);
+    engine.setCancellationToken(&cancellation);
+    size_t resultCount = 0;
+
+    // While streaming, loading and comparing overlap; progress counts pairs,
+    // which is where the time goes on large sets
+    const qint64 totalPairs = static_cast<qint64>(fileCount) * (fileCount - 1) / 2;
+    qint64 pairsBefore = 0;
+    if (streaming) {
+        const QString stage = tr("Comparing");
+        engine.setProgressCallback([this, &pairsBefore, totalPairs, stage](size_t done, size_t) {
+            reportProgress(pairsBefore + static_cast<qint64>(done), totalPairs, stage);
+        });
+    }
+
+    std::vector<bool> isPending(files.size(), false);
+    for (int index : pendingFiles) {
+        isPending[index] = true;
+    }
+
+    auto compareFile = [&](int index) {
+        // Cache the processed content right away, so the details of a pair
+        // can be opened while the rest is still comparing
+        if (isPending[index]) {
+            QMutexLocker locker(&m_cacheMutex);
+            m_fileCache[files[index].path] = {modified[index], sizes[index], tokenMode, files[index]};
         }
+
+        if (!streaming) return;
+        auto pairResults = engine.addDocument(static_cast<size_t>(index), documentFor(files[index]));
+        pairsBefore += static_cast<qint64>(pairResults.size());
+        resultCount += pairResults.size();
+        comparisons += publishResults(std::move(pairResults), filePaths, totalScore);
+    };
+
+    // Every file is compared with the ones before it as soon as it is ready
+    LoadPipeline::Options loadOptions;
+    loadOptions.k = KGRAM_SIZE;
+    loadOptions.windowSize = WINNOW_WINDOW;
+    loadOptions.tokenMode = tokenMode;
+    LoadPipeline pipeline(loadOptions, m_store.get());
+    pipeline.setCancellationToken(&cancellation);
+    pipeline.setBaseFilter(m_baseFilter.get());
+    if (!streaming) {
+        const QString stage = tr("Loading files");
+        pipeline.setProgressCallback([this, stage](size_t done, size_t total) {
+            reportProgress(static_cast<qint64>(done), static_cast<qint64>(total), stage);
+        });
+    }
+    beginStage();
+    if (!pipeline.run(files, localPaths, pendingFiles, cachedFiles, compareFile)) {
+        emit errorOccurred(pipeline.errorString());
+        return;
     }
 
-    if (comparisons == 0) {
+    m_loadedFiles = std::move(files);
+
+    if (!streaming) {
+        auto results = compareAllFiles(options, query, cancellation);
+        resultCount = results.size();
+        comparisons += publishResults(std::move(results), filePaths, totalScore);
+    }
+
+    m_resultsComplete = true;
+    if (comparisons == 0 && resultCount == 0 && !streaming) {
+        // No pair came close enough to be compared
+        emit comparisonFinished(0.0, 0);
+    } else if (comparisons == 0) {
         emit errorOccurred(tr("No valid comparisons could be made"));
     } else {
-        double averageScore = totalScore / comparisons;
-        emit comparisonFinished(averageScore * 100, matches);
+        emit comparisonFinished(totalScore / comparisons, comparisons);
+    }
+
+    // Rewrites the whole store, so only once the results are out
+    m_store->save();
+}
+
+void Backend::updateWatchedFiles()
+{
+    // The worker owns the file lists while it runs
+    if (m_watcher.isRunning()) {
+        return;
+    }
+
+    const QStringList watched = m_fileWatcher.files() + m_fileWatcher.directories();
+    if (!watched.isEmpty()) {
+        m_fileWatcher.removePaths(watched);
+    }
+    m_watchedFiles.clear();
+    m_watchedArchives.clear();
+    m_watchedDirectories.clear();
+    if (!m_watchFiles) {
+        m_changeTimer.stop();
+        m_changedFiles.clear();
+        return;
+    }
+
+    QStringList localPaths;
+    for (int i = 0; i < m_loadedPaths.size(); ++i) {
+        const QString localPath = localPathOf(m_loadedPaths[i]);
+        m_watchedFiles.insert(localPath, i);
+        localPaths << localPath;
+    }
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        localPaths << m_duplicateOf.keys();
+    }
+
+    // Collected files only cover what the inputs held at the last run:
+    // archives are unpacked copies, and directories can gain files
+    for (const QString &input : std::as_const(m_inputPaths)) {
+        const QString localPath = localPathOf(input);
+        const QFileInfo info(localPath);
+        if (info.isDir()) {
+            m_watchedDirectories.insert(localPath, collectedEntries(localPath));
+            QDirIterator it(localPath, QDir::Dirs | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                const QString directory = it.next();
+                m_watchedDirectories.insert(directory, collectedEntries(directory));
+            }
+        } else if (SubmissionCollector::isArchive(localPath)) {
+            m_watchedArchives.insert(localPath);
+        }
+    }
+    localPaths << m_watchedDirectories.keys() << QStringList(m_watchedArchives.begin(), m_watchedArchives.end());
+
+    if (!localPaths.isEmpty()) {
+        m_fileWatcher.addPaths(localPaths);
     }
 }
 
-void Backend::cancelProcessing()
+void Backend::compareChangedFiles()
 {
+    if (m_changedFiles.isEmpty() || !m_watchFiles) {
+        return;
+    }
+    // Changes made during a run are picked up once it is over
     if (m_watcher.isRunning()) {
-        m_watcher.cancel();
-        setProcessing(false);
+        m_changeTimer.start();
+        return;
+    }
+    // Without the full results of the last run there is nothing to update,
+    // and a changed score can move any pair in or out of the top pairs
+    if (!m_resultsComplete || m_topPairs > 0) {
+        m_changedFiles.clear();
+        processFiles(m_inputPaths);
+        return;
+    }
+    // A changed file that was collapsed with others can no longer stand in
+    // for them, and a changed archive or directory can hold different
+    // files; both need a full run
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        for (const QString &localPath : std::as_const(m_changedFiles)) {
+            if (m_duplicateOf.contains(localPath) || m_copiesOf.contains(localPath) ||
+                m_watchedArchives.contains(localPath) || m_watchedDirectories.contains(localPath)) {
+                locker.unlock();
+                m_changedFiles.clear();
+                processFiles(m_inputPaths);
+                return;
+            }
+        }
+    }
+
+    std::vector<int> changed;
+    QStringList changedPaths;
+    const QStringList watched = m_fileWatcher.files();
+    for (const QString &localPath : std::as_const(m_changedFiles)) {
+        // A deleted file keeps its last results
+        if (!QFileInfo::exists(localPath)) continue;
+        // Editors that save by replacing the file drop it from the watcher
+        if (!watched.contains(localPath)) {
+            m_fileWatcher.addPath(localPath);
+        }
+        const int index = m_watchedFiles.value(localPath, -1);
+        if (index >= 0) {
+            changed.push_back(index);
+            changedPaths << m_loadedPaths[index];
+        }
+    }
+    m_changedFiles.clear();
+    if (changed.empty()) {
+        return;
+    }
+    std::sort(changed.begin(), changed.end());
+
+    setProcessing(true);
+    setProgress(0, 0, QString(), -1);
+
+    // Only the details of the changed files' pairs are stale
+    for (auto it = m_detailCache.begin(); it != m_detailCache.end();) {
+        const QStringList pair = it.key().split(QLatin1Char('\n'));
+        if (changedPaths.contains(pair.first()) || changedPaths.contains(pair.last())) {
+            it = m_detailCache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_pendingDetails.clear();
+    ++m_detailGeneration;
+    for (const QString &path : std::as_const(changedPaths)) {
+        m_processedCache.remove(path);
+    }
+
+    const QStringList filePaths = m_loadedPaths;
+    const bool tokenMode = m_loadedTokenMode;
+    const ComparisonEngine::Options options = comparisonOptions();
+    const double minSimilarity = m_minSimilarity;
+    startJob([this, filePaths, changed, tokenMode, options, minSimilarity](const CancellationToken &cancellation) {
+        recompareFiles(filePaths, changed, tokenMode, options, minSimilarity, cancellation);
+    });
+}
+
+void Backend::recompareFiles(const QStringList &filePaths, const std::vector<int> &changed, bool tokenMode,
+                             const ComparisonEngine::Options &options, double minSimilarity,
+                             const CancellationToken &cancellation)
+{
+    const size_t fileCount = m_loadedFiles.size();
+    std::vector<FileContent> fresh(fileCount);
+    std::vector<QString> localPaths(fileCount);
+    std::vector<QDateTime> modified(fileCount);
+    std::vector<qint64> sizes(fileCount);
+    std::vector<bool> isChanged(fileCount, false);
+    for (int index : changed) {
+        fresh[index].path = filePaths[index];
+        localPaths[index] = localPathOf(filePaths[index]);
+        QFileInfo info(localPaths[index]);
+        modified[index] = info.lastModified();
+        sizes[index] = info.size();
+        isChanged[index] = true;
+    }
+
+    LoadPipeline::Options loadOptions;
+    loadOptions.k = KGRAM_SIZE;
+    loadOptions.windowSize = WINNOW_WINDOW;
+    loadOptions.tokenMode = tokenMode;
+    LoadPipeline pipeline(loadOptions, m_store.get());
+    pipeline.setCancellationToken(&cancellation);
+    pipeline.setBaseFilter(m_baseFilter.get());
+    const QString loadStage = tr("Loading files");
+    pipeline.setProgressCallback([this, loadStage](size_t done, size_t total) {
+        reportProgress(static_cast<qint64>(done), static_cast<qint64>(total), loadStage);
+    });
+    beginStage();
+    if (!pipeline.run(fresh, localPaths, changed, {}, [](int) {})) {
+        emit errorOccurred(pipeline.errorString());
+        return;
+    }
+    // The store is not saved here: saving rewrites it as a whole, which
+    // would dwarf the update. The new entries stay in memory until the
+    // next full run or until the backend goes away.
+
+    std::vector<ComparisonEngine::Document> documents;
+    documents.reserve(fileCount);
+    for (size_t i = 0; i < fileCount; ++i) {
+        documents.push_back(documentFor(isChanged[i] ? fresh[i] : m_loadedFiles[i]));
+    }
+
+    ComparisonEngine engine(RabinKarp(WINNOW_WINDOW), options);
+    engine.setCancellationToken(&cancellation);
+    const QString compareStage = tr("Comparing");
+    engine.setProgressCallback([this, compareStage](size_t done, size_t total) {
+        reportProgress(static_cast<qint64>(done), static_cast<qint64>(total), compareStage);
+    });
+    beginStage();
+    auto results = engine.compareChanged(documents, std::vector<size_t>(changed.begin(), changed.end()));
+    cancellation.throwIfCancelled();
+    results.erase(std::remove_if(results.begin(), results.end(),
+                                 [minSimilarity](const ComparisonEngine::PairResult &result) {
+                                     return result.compared && result.similarity < minSimilarity;
+                                 }),
+                  results.end());
+
+    // The new content replaces the old only once its pairs are scored, so a
+    // cancelled update leaves files and results as they were
+    QStringList changedPaths;
+    for (int index : changed) {
+        changedPaths << filePaths[index];
+        {
+            QMutexLocker locker(&m_cacheMutex);
+            m_fileCache[filePaths[index]] = {modified[index], sizes[index], tokenMode, fresh[index]};
+        }
+        m_loadedFiles[index] = std::move(fresh[index]);
+    }
+
+    double totalScore = 0;
+    publishResults(std::move(results), filePaths, totalScore, changedPaths);
+    QMetaObject::invokeMethod(this, [this, changedPaths]() {
+        emit resultsUpdated(m_results.averageScore(), m_results.rowCount(), changedPaths);
+    }, Qt::QueuedConnection);
+}
+
+ComparisonEngine::Options Backend::comparisonOptions() const
+{
+    ComparisonEngine::Options options;
+    options.k = KGRAM_SIZE;
+    options.threads = static_cast<size_t>(QThread::idealThreadCount());
+    options.matchRuns = true;
+    options.minRunLength = MIN_RUN_LENGTH;
+    options.maxPostings = MAX_POSTINGS;
+    // Match runs are only computed for the pairs the user opens
+    options.scoresOnly = true;
+    options.candidateFilter = m_candidateFilter;
+    options.minHash.bands = static_cast<size_t>(m_lshBands);
+    options.minHash.rows = static_cast<size_t>(m_lshRows);
+    options.minHash.threshold = m_candidateThreshold;
+    return options;
+}
+
+ComparisonEngine::Query Backend::comparisonQuery() const
+{
+    return {m_minSimilarity, static_cast<size_t>(m_topPairs)};
+}
+
+bool Backend::isQuery(const ComparisonEngine::Query &query)
+{
+    return query.minSimilarity > 0.0 || query.topK > 0;
+}
+
+ComparisonEngine::Document Backend::documentFor(const FileContent &file)
+{
+    return {file.processedContent, &file.fingerprints, file.tokens.empty() ? nullptr : &file.tokens};
+}
+
+std::vector<ComparisonEngine::PairResult> Backend::compareAllFiles(const ComparisonEngine::Options &options,
+                                                                   const ComparisonEngine::Query &query,
+                                                                   const CancellationToken &cancellation)
+{
+    std::vector<ComparisonEngine::Document> documents;
+    documents.reserve(m_loadedFiles.size());
+    for (const auto &file : m_loadedFiles) {
+        documents.push_back(documentFor(file));
+    }
+
+    ComparisonEngine engine(RabinKarp(WINNOW_WINDOW), options);
+    engine.setCancellationToken(&cancellation);
+    const QString stage = tr("Comparing");
+    engine.setProgressCallback([this, stage](size_t done, size_t total) {
+        reportProgress(static_cast<qint64>(done), static_cast<qint64>(total), stage);
+    });
+    beginStage();
+
+    auto results = isQuery(query) ? engine.query(documents, query) : engine.compareAll(documents);
+    cancellation.throwIfCancelled();
+    return results;
+}
+
+int Backend::publishResults(std::vector<ComparisonEngine::PairResult> &&results, const QStringList &paths,
+                            double &totalScore, const QStringList &replaced)
+{
+    Profiler::Scope scope(Profiler::Marshalling);
+    std::vector<ResultModel::Entry> batch;
+    batch.reserve(results.size());
+    QMutexLocker locker(&m_cacheMutex);
+    for (auto &result : results) {
+        if (!result.compared) {
+            qWarning() << "Comparison error:" << result.error.c_str();
+            continue;
+        }
+
+        // Files collapsed into either side share its score
+        const QString &file1 = paths[static_cast<int>(result.file1)];
+        const QString &file2 = paths[static_cast<int>(result.file2)];
+        const QStringList copies1 = QStringList{file1} + m_copiesOf.value(file1);
+        const QStringList copies2 = QStringList{file2} + m_copiesOf.value(file2);
+        const double score = result.similarity * 100;
+        for (const QString &copy1 : copies1) {
+            for (const QString &copy2 : copies2) {
+                batch.push_back({copy1, copy2, score});
+                totalScore += score;
+            }
+        }
+    }
+    locker.unlock();
+
+    return postResults(std::move(batch), replaced);
+}
+
+int Backend::postResults(std::vector<ResultModel::Entry> &&batch, const QStringList &replaced)
+{
+    // The model lives on the GUI thread
+    const int count = static_cast<int>(batch.size());
+    Profiler::add(Profiler::ResultsPublished, static_cast<uint64_t>(count));
+    if (!replaced.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this, replaced, batch = std::move(batch)]() mutable {
+            Profiler::Scope scope(Profiler::Marshalling);
+            m_results.replaceResults(replaced, std::move(batch));
+        }, Qt::QueuedConnection);
+    } else if (count > 0) {
+        QMetaObject::invokeMethod(this, [this, batch = std::move(batch)]() mutable {
+            Profiler::Scope scope(Profiler::Marshalling);
+            m_results.addResults(std::move(batch));
+        }, Qt::QueuedConnection);
+    }
+    return count;
+}
+
+void Backend::requestMatchDetail(const QString &file1, const QString &file2)
+{
+    const QString key = file1 + QLatin1Char('\n') + file2;
+    auto cached = m_detailCache.constFind(key);
+    if (cached != m_detailCache.constEnd()) {
+        emit matchDetailReady(file1, file2, *cached);
+        return;
+    }
+    if (m_pendingDetails.contains(key)) {
+        return;
+    }
+
+    FileContent content1;
+    FileContent content2;
+    {
+        QMutexLocker locker(&m_cacheMutex);
+        // A collapsed file has the content of the file it duplicates
+        auto cached1 = m_fileCache.constFind(m_duplicateOf.value(file1, file1));
+        auto cached2 = m_fileCache.constFind(m_duplicateOf.value(file2, file2));
+        if (cached1 == m_fileCache.constEnd() || cached2 == m_fileCache.constEnd()) {
+            emit errorOccurred(tr("Match details are not available for these files"));
+            return;
+        }
+        content1 = cached1->file;
+        content2 = cached2->file;
+    }
+
+    m_pendingDetails.insert(key);
+    const int generation = m_detailGeneration;
+    const ComparisonEngine::Options options = comparisonOptions();
+
+    QtConcurrent::run([file1, file2, content1 = std::move(content1), content2 = std::move(content2), options]() {
+        MatchDetail detail;
+        ComparisonEngine engine(RabinKarp(WINNOW_WINDOW), options);
+        auto result = engine.compare(documentFor(content1), documentFor(content2));
+        if (!result.compared) {
+            detail.error = QString::fromStdString(result.error);
+            return detail;
+        }
+
+        SourceFile source1;
+        SourceFile source2;
+        OffsetMap map1;
+        OffsetMap map2;
+        if (!mapFile(file1, content1, source1, map1) || !mapFile(file2, content2, source2, map2)) {
+            detail.error = tr("The files changed since they were compared");
+            return detail;
+        }
+
+        std::vector<std::pair<size_t, size_t>> processed1;
+        std::vector<std::pair<size_t, size_t>> processed2;
+        for (const auto &run : result.runs) {
+            processed1.emplace_back(run.start1, run.length);
+            processed2.emplace_back(run.start2, run.length);
+        }
+        detail.ranges1 = displayRanges(source1, map1, processed1);
+        detail.ranges2 = displayRanges(source2, map2, processed2);
+        detail.runs = std::move(result.runs);
+        return detail;
+    }).then(this, [this, key, file1, file2, generation](const MatchDetail &detail) {
+        // Dropped when a new run started in the meantime
+        if (generation != m_detailGeneration) {
+            return;
+        }
+        m_pendingDetails.remove(key);
+
+        if (!detail.error.isEmpty()) {
+            qWarning() << "Comparison error:" << detail.error;
+            emit errorOccurred(tr("Could not compute match details: %1").arg(detail.error));
+            return;
+        }
+
+        QVariantList segments;
+        for (size_t i = 0; i < detail.runs.size(); ++i) {
+            const auto &run = detail.runs[i];
+            QVariantMap segment;
+            segment["pos1"] = static_cast<int>(run.start1);
+            segment["pos2"] = static_cast<int>(run.start2);
+            segment["length"] = static_cast<int>(run.length);
+            segment["start1"] = static_cast<int>(detail.ranges1[i].begin);
+            segment["end1"] = static_cast<int>(detail.ranges1[i].end);
+            segment["start2"] = static_cast<int>(detail.ranges2[i].begin);
+            segment["end2"] = static_cast<int>(detail.ranges2[i].end);
+            segments.append(segment);
+        }
+        m_detailCache.insert(key, segments);
+        emit matchDetailReady(file1, file2, segments);
+    });
+}
+
+void Backend::cancelProcessing()
+{
+    if (m_watcher.isRunning() && !m_cancellation->isCancelled()) {
+        // The worker unwinds at its next checkpoint; processing turns false
+        // once it has
+        m_cancellation->cancel();
         emit errorOccurred(tr("Processing cancelled by user"));
     }
 }
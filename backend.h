@@ -4,43 +4,249 @@
 #include <QObject>
 #include <QStringList>
 #include <QFutureWatcher>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFileSystemWatcher>
+#include <QMutex>
+#include <QSet>
+#include <QTimer>
 #include <QVariantList>
+#include <QVariantMap>
+#include "Cancellation.h"
+#include "Rabin_karp.h"
+#include "ComparisonEngine.h"
+#include "FingerprintStore.h"
+#include "LoadPipeline.h"
+#include "resultmodel.h"
+#include "BaseCodeFilter.h"
+#include "SubmissionCollector.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
 
-struct FileContent {
-    QString path;
-    QString content;
-    QString processedContent;
+// Processed text and fingerprints of a file, valid while the file on disk
+// keeps the same modification time and size
+struct CachedFile {
+    QDateTime lastModified;
+    qint64 size = 0;
+    bool tokenMode = false;
+    FileContent file;
 };
 
 class Backend : public QObject
 {
     Q_OBJECT
     Q_PROPERTY(bool processing READ isProcessing NOTIFY processingChanged)
+    Q_PROPERTY(bool tokenMode READ tokenMode WRITE setTokenMode NOTIFY tokenModeChanged)
+    Q_PROPERTY(bool candidateFilter READ candidateFilter WRITE setCandidateFilter NOTIFY candidateFilterChanged)
+    Q_PROPERTY(int lshBands READ lshBands WRITE setLshBands NOTIFY lshBandsChanged)
+    Q_PROPERTY(int lshRows READ lshRows WRITE setLshRows NOTIFY lshRowsChanged)
+    Q_PROPERTY(double candidateThreshold READ candidateThreshold WRITE setCandidateThreshold NOTIFY candidateThresholdChanged)
+    Q_PROPERTY(double minSimilarity READ minSimilarity WRITE setMinSimilarity NOTIFY minSimilarityChanged)
+    Q_PROPERTY(int topPairs READ topPairs WRITE setTopPairs NOTIFY topPairsChanged)
+    Q_PROPERTY(bool watchFiles READ watchFiles WRITE setWatchFiles NOTIFY watchFilesChanged)
+    Q_PROPERTY(QStringList baseFiles READ baseFiles WRITE setBaseFiles NOTIFY baseFilesChanged)
+    Q_PROPERTY(bool profiling READ profiling WRITE setProfiling NOTIFY profilingChanged)
+    Q_PROPERTY(QString traceFile READ traceFile WRITE setTraceFile NOTIFY traceFileChanged)
+    Q_PROPERTY(QVariantMap stats READ stats NOTIFY statsChanged)
+    Q_PROPERTY(qint64 progressDone READ progressDone NOTIFY progressChanged)
+    Q_PROPERTY(qint64 progressTotal READ progressTotal NOTIFY progressChanged)
+    Q_PROPERTY(QString progressStage READ progressStage NOTIFY progressChanged)
+    Q_PROPERTY(int progressEta READ progressEta NOTIFY progressChanged)
+    Q_PROPERTY(ResultModel *results READ results CONSTANT)
 
 public:
     explicit Backend(QObject *parent = nullptr);
+    // Stops a running job and writes fingerprints still held in memory
+    ~Backend() override;
 
     bool isProcessing() const;
+
+    // Fingerprint token streams instead of normalized characters
+    bool tokenMode() const;
+    void setTokenMode(bool tokenMode);
+
+    // MinHash/LSH candidate filtering for large file sets. More bands find
+    // more similar pairs (recall), more rows reject more dissimilar ones
+    // (precision); candidates below the estimated-similarity threshold
+    // (0..1) are not compared.
+    bool candidateFilter() const;
+    void setCandidateFilter(bool enabled);
+    int lshBands() const;
+    void setLshBands(int bands);
+    int lshRows() const;
+    void setLshRows(int rows);
+    double candidateThreshold() const;
+    void setCandidateThreshold(double threshold);
+
+    // Report only pairs with at least minSimilarity (0..1), and only the
+    // topPairs best when that is above 0. Pairs that cannot get there are
+    // skipped on cheap bounds instead of being scored, so a high bar makes
+    // large runs much faster; either setting turns off streaming results.
+    double minSimilarity() const;
+    void setMinSimilarity(double similarity);
+    int topPairs() const;
+    void setTopPairs(int count);
+
+    // Watch the files of the last run and rescore them when they change on
+    // disk: only the changed files are reloaded and only their pairs are
+    // compared again, every other result stays as it is
+    bool watchFiles() const;
+    void setWatchFiles(bool watch);
+
+    // Starter code handed out to everyone; its fingerprints are dropped
+    // from every file, so it adds neither to the scores nor to the matches.
+    // Applies from the next run on.
+    QStringList baseFiles() const;
+    void setBaseFiles(const QStringList &files);
+
+    // Time the stages of every run and count what they did; the totals
+    // since the last resetStats() are in stats. With a traceFile as well,
+    // the stages are saved there after each run as a Chrome trace that
+    // chrome://tracing and ui.perfetto.dev open.
+    bool profiling() const;
+    void setProfiling(bool profiling);
+    QString traceFile() const;
+    void setTraceFile(const QString &path);
+    // stages maps each stage name to {calls, ms}, counters each counter
+    // name to its value
+    QVariantMap stats() const;
+    Q_INVOKABLE void resetStats();
+
+    // Progress of the running stage (files while loading, pairs while
+    // comparing) and the estimated seconds left in it, -1 while unknown
+    qint64 progressDone() const;
+    qint64 progressTotal() const;
+    QString progressStage() const;
+    int progressEta() const;
+
+    // Pairs of the current run, filled while it is still comparing
+    ResultModel *results();
+
+    // Takes files, directories and archives; files with the same content
+    // are compared once and listed as 100% matches of each other
     Q_INVOKABLE void processFiles(const QStringList &filePaths);
     Q_INVOKABLE void cancelProcessing();
     Q_INVOKABLE QString getProcessedContent(const QString &filePath);
 
+    // Computes the match runs of one pair in the background and answers
+    // with matchDetailReady; results are cached until the next run
+    Q_INVOKABLE void requestMatchDetail(const QString &file1, const QString &file2);
+
 signals:
     void processingChanged(bool processing);
-    void comparisonFinished(double similarityScore, const QVariantList &matches);
+    void tokenModeChanged(bool tokenMode);
+    void candidateFilterChanged(bool enabled);
+    void lshBandsChanged(int bands);
+    void lshRowsChanged(int rows);
+    void candidateThresholdChanged(double threshold);
+    void minSimilarityChanged(double similarity);
+    void topPairsChanged(int count);
+    void watchFilesChanged(bool watch);
+    void baseFilesChanged(const QStringList &files);
+    void profilingChanged(bool profiling);
+    void traceFileChanged(const QString &path);
+    void statsChanged();
+    void progress(qint64 done, qint64 total, const QString &stage);
+    void progressChanged();
+    void comparisonFinished(double similarityScore, int pairCount);
+    // The pairs of changedFiles were compared again after they changed on
+    // disk; the scores cover all pairs in the results
+    void resultsUpdated(double similarityScore, int pairCount, const QStringList &changedFiles);
+    // segments holds one map per match run: pos1, pos2 and length in the
+    // processed texts, and start1/end1 and start2/end2 as positions in the
+    // file text FileReader::readFile() returns
+    void matchDetailReady(const QString &file1, const QString &file2, const QVariantList &segments);
     void errorOccurred(const QString &message);
 
 private slots:
     void setProcessing(bool processing);
+    void setProgress(qint64 done, qint64 total, const QString &stage, int eta);
 
 private:
     QString loadAndPreprocess(const QString &filePath);
-    void compareAllFiles();
+    void startJob(std::function<void(const CancellationToken &)> job);
+    // The jobs get the settings as they were when the run started; the
+    // properties may change on the GUI thread while they work
+    void loadAndCompare(const QStringList &inputPaths, const QStringList &baseFiles, bool tokenMode,
+                        const ComparisonEngine::Options &options, const ComparisonEngine::Query &query,
+                        const CancellationToken &cancellation);
+    void updateWatchedFiles();
+    void compareChangedFiles();
+    void recompareFiles(const QStringList &filePaths, const std::vector<int> &changed, bool tokenMode,
+                        const ComparisonEngine::Options &options, double minSimilarity,
+                        const CancellationToken &cancellation);
+    std::vector<ComparisonEngine::PairResult> compareAllFiles(const ComparisonEngine::Options &options,
+                                                              const ComparisonEngine::Query &query,
+                                                              const CancellationToken &cancellation);
+    void beginStage();
+    void reportProgress(qint64 done, qint64 total, const QString &stage);
+    // Posts the results to the model; with replaced, they take the place
+    // of the rows involving those files
+    int publishResults(std::vector<ComparisonEngine::PairResult> &&results, const QStringList &paths,
+                       double &totalScore, const QStringList &replaced = QStringList());
+    int postResults(std::vector<ResultModel::Entry> &&batch, const QStringList &replaced = QStringList());
+    ComparisonEngine::Options comparisonOptions() const;
+    ComparisonEngine::Query comparisonQuery() const;
+    // Only the pairs above minSimilarity or among the topPairs are wanted
+    static bool isQuery(const ComparisonEngine::Query &query);
+    static ComparisonEngine::Document documentFor(const FileContent &file);
 
     bool m_isProcessing = false;
+    bool m_tokenMode = false;
+    bool m_candidateFilter = false;
+    int m_lshBands = 32;
+    int m_lshRows = 4;
+    double m_candidateThreshold = 0.2;
+    double m_minSimilarity = 0.0;
+    int m_topPairs = 0;
+    bool m_watchFiles = false;
+    QStringList m_baseFiles;
+    bool m_profiling = false;
+    QString m_traceFile;
     QFutureWatcher<void> m_watcher;
-    QList<FileContent> m_loadedFiles;
+    std::shared_ptr<CancellationToken> m_cancellation;
+    ResultModel m_results;
+
+    qint64 m_progressDone = 0;
+    qint64 m_progressTotal = 0;
+    QString m_progressStage;
+    int m_progressEta = -1;
+    // Written from worker threads, as milliseconds of m_progressClock
+    QElapsedTimer m_progressClock;
+    std::atomic<qint64> m_stageStart{0};
+    std::atomic<qint64> m_lastProgress{0};
+    std::vector<FileContent> m_loadedFiles;
+    // Inputs and collected files of the last run, for watching;
+    // m_resultsComplete is set once all of its pairs are in the results
+    QStringList m_inputPaths;
+    QStringList m_loadedPaths;
+    std::unique_ptr<SubmissionCollector> m_collector;
+    bool m_loadedTokenMode = false;
+    std::atomic<bool> m_resultsComplete{false};
+    QFileSystemWatcher m_fileWatcher;
+    QHash<QString, int> m_watchedFiles;  // local path to index in m_loadedPaths
+    // Input archives, and input directories with their subdirectories,
+    // mapped to the entries a collector takes from them; a change to any
+    // of these needs a full run
+    QSet<QString> m_watchedArchives;
+    QHash<QString, QStringList> m_watchedDirectories;
+    QSet<QString> m_changedFiles;
+    QTimer m_changeTimer;
     QHash<QString, QString> m_processedCache;
+    QHash<QString, CachedFile> m_fileCache;  // guarded by m_cacheMutex, filled by the worker
+    QHash<QString, QString> m_duplicateOf;  // collapsed file to the one it duplicates, guarded by m_cacheMutex
+    QHash<QString, QStringList> m_copiesOf;  // the reverse of m_duplicateOf, guarded by m_cacheMutex
+    QMutex m_cacheMutex;
+    QHash<QString, QVariantList> m_detailCache;
+    QSet<QString> m_pendingDetails;
+    int m_detailGeneration = 0;
+    std::unique_ptr<FingerprintStore> m_store;
+    // Base code of the last run; the fingerprints in m_fileCache and
+    // m_loadedFiles are filtered with it
+    std::shared_ptr<const BaseCodeFilter> m_baseFilter;
 };
 
 #endif // BACKEND_H
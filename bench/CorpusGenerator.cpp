@@ -0,0 +1,489 @@
+#include "CorpusGenerator.h"
+#include <algorithm>
+
+namespace {
+
+const char *const TYPES[] = {
+    "int", "long", "unsigned", "double", "char", "size_t", "float", "bool", "short", "unsigned long",
+    "long long", "uint8_t", "int64_t", "const char *", "void *", "struct entry *", "signed char", "ssize_t",
+};
+constexpr int TYPE_COUNT = sizeof(TYPES) / sizeof(TYPES[0]);
+
+const char *const BINARY_OPERATORS[] = {"+", "-", "*", "/", "%", "<<", ">>", "&", "|", "^", "&&", "||"};
+constexpr int BINARY_COUNT = sizeof(BINARY_OPERATORS) / sizeof(BINARY_OPERATORS[0]);
+
+const char *const COMPARISONS[] = {"<", ">", "<=", ">=", "==", "!="};
+constexpr int COMPARISON_COUNT = sizeof(COMPARISONS) / sizeof(COMPARISONS[0]);
+
+const char *const ASSIGNMENTS[] = {"=", "+=", "-=", "*=", "|=", "^=", "&=", "<<=", ">>=", "/=", "%="};
+constexpr int ASSIGNMENT_COUNT = sizeof(ASSIGNMENTS) / sizeof(ASSIGNMENTS[0]);
+
+const char *const UNARY_OPERATORS[] = {"!", "-", "~", "*", "&"};
+constexpr int UNARY_COUNT = sizeof(UNARY_OPERATORS) / sizeof(UNARY_OPERATORS[0]);
+
+const char *const FORMATS[] = {
+    "\"%d\\n\"", "\"%s: %d\\n\"", "\"value=%ld\"", "\"[%u] %s\\n\"", "\"error %d\"", "\"%f %f\\n\"", "\"ok\"",
+};
+constexpr int FORMAT_COUNT = sizeof(FORMATS) / sizeof(FORMATS[0]);
+
+const char *const WORDS[] = {
+    "count", "index", "value", "total", "buffer", "node", "next", "size", "result", "temp",
+    "left", "right", "sum", "key", "data", "item", "list", "queue", "score", "limit",
+};
+constexpr int WORD_COUNT = sizeof(WORDS) / sizeof(WORDS[0]);
+
+const char *const COMMENTS[] = {
+    "// update the running value",
+    "/* edge case: empty input */",
+    "// TODO: handle overflow",
+    "/* keep this in sync with the header */",
+    "// fast path",
+};
+constexpr int COMMENT_COUNT = sizeof(COMMENTS) / sizeof(COMMENTS[0]);
+
+// Statement kinds; the ones from IF on contain other statements
+enum StatementKind {
+    DECLARE, ASSIGN, CALL, STEP, RETURN, MEMBER, POINTER, ARRAY, PRINT, SIZEOF, SELECT, LOOP_EXIT,
+    IF, WHILE, FOR, DO_WHILE, SWITCH, STATEMENT_KINDS
+};
+
+// Expression kinds; the ones from BINARY on contain other expressions
+enum ExpressionKind {
+    SLOT, NUMBER, ELEMENT, FIELD, STRING, CHARACTER,
+    BINARY, PARENS, INVOKE, CAST, UNARY, TERNARY, SIZE_OF, EXPRESSION_KINDS
+};
+
+}
+
+CorpusGenerator::CorpusGenerator(const Options &options)
+    : m_options(options), m_rng(options.seed)
+{
+}
+
+CorpusGenerator::Corpus CorpusGenerator::generate()
+{
+    Corpus corpus;
+    std::vector<Program> programs;
+    std::vector<size_t> originals;
+    std::bernoulli_distribution isCopy(m_options.copyRate);
+
+    for (size_t i = 0; i < m_options.files; ++i) {
+        if (!originals.empty() && isCopy(m_rng)) {
+            const size_t source = originals[m_rng() % originals.size()];
+            programs.push_back(copyProgram(programs[source]));
+            corpus.files.push_back(render(programs.back(), true));
+            corpus.copies.emplace_back(source, i);
+        } else {
+            programs.push_back(randomProgram(m_options.fileSize));
+            corpus.files.push_back(render(programs.back(), false));
+            originals.push_back(i);
+        }
+    }
+    return corpus;
+}
+
+std::string CorpusGenerator::randomName()
+{
+    std::string name = WORDS[m_rng() % WORD_COUNT];
+    if (m_rng() % 2) {
+        name += '_';
+        name += WORDS[m_rng() % WORD_COUNT];
+    }
+    return name + std::to_string(m_rng() % 100);
+}
+
+// A few kinds dominate each style and about a third never appear, which is
+// what keeps two unrelated files apart once identifiers and literals are
+// normalized away
+CorpusGenerator::Style CorpusGenerator::randomStyle()
+{
+    std::uniform_real_distribution<double> weight(0.0, 1.0);
+    std::bernoulli_distribution uses(0.5);
+    auto weights = [&](int count) {
+        std::vector<double> result(count);
+        for (auto &w : result) {
+            const double u = weight(m_rng);
+            w = uses(m_rng) ? u * u * u * u : 0.0;
+        }
+        return result;
+    };
+
+    // One simple statement and one leaf expression stay possible so that
+    // nesting always ends
+    std::vector<double> statements = weights(STATEMENT_KINDS);
+    statements[m_rng() % LOOP_EXIT] += 0.1;
+    std::vector<double> expressions = weights(EXPRESSION_KINDS);
+    expressions[m_rng() % BINARY] += 0.1;
+
+    auto subset = [&](int count, int minimum, int maximum) {
+        std::vector<int> all(count);
+        for (int i = 0; i < count; ++i) {
+            all[i] = i;
+        }
+        std::shuffle(all.begin(), all.end(), m_rng);
+        all.resize(minimum + m_rng() % (maximum - minimum + 1));
+        return all;
+    };
+
+    Style style;
+    style.statements = std::discrete_distribution<int>(statements.begin(), statements.end());
+    style.expressions = std::discrete_distribution<int>(expressions.begin(), expressions.end());
+    style.types = subset(TYPE_COUNT, 2, 6);
+    style.operators = subset(BINARY_COUNT, 3, 7);
+    style.assignments = subset(ASSIGNMENT_COUNT, 1, 4);
+    style.comparisons = subset(COMPARISON_COUNT, 2, 4);
+    style.braceOnOwnLine = m_rng() % 2;
+    return style;
+}
+
+std::string CorpusGenerator::randomType(const Program &program)
+{
+    return TYPES[program.style.types[m_rng() % program.style.types.size()]];
+}
+
+const char *CorpusGenerator::randomAssignment(const Program &program)
+{
+    return ASSIGNMENTS[program.style.assignments[m_rng() % program.style.assignments.size()]];
+}
+
+const char *CorpusGenerator::randomComparison(const Program &program)
+{
+    return COMPARISONS[program.style.comparisons[m_rng() % program.style.comparisons.size()]];
+}
+
+// Placeholders are '$' followed by 'a' + the index into the name table, so
+// a copy can rename identifiers without regenerating its statements
+std::string CorpusGenerator::randomSlot(const Program &program)
+{
+    return std::string("$") + static_cast<char>('a' + m_rng() % program.nameCount);
+}
+
+std::string CorpusGenerator::randomArguments(Program &program, int depth)
+{
+    std::string arguments;
+    for (int i = 0, count = m_rng() % 4; i < count; ++i) {
+        if (i > 0) {
+            arguments += ", ";
+        }
+        arguments += randomExpression(program, depth);
+    }
+    return arguments;
+}
+
+std::string CorpusGenerator::randomExpression(Program &program, int depth)
+{
+    int kind = program.style.expressions(m_rng);
+    while (depth <= 0 && kind >= BINARY) {
+        kind = program.style.expressions(m_rng);
+    }
+
+    switch (kind) {
+    case SLOT:
+        return randomSlot(program);
+    case NUMBER:
+        return std::to_string(m_rng() % 1000);
+    case ELEMENT:
+        return randomSlot(program) + "[" + randomSlot(program) + "]";
+    case FIELD:
+        return randomSlot(program) + (m_rng() % 2 ? "." : "->") + randomSlot(program);
+    case STRING:
+        return FORMATS[m_rng() % FORMAT_COUNT];
+    case CHARACTER:
+        return std::string("'") + static_cast<char>('a' + m_rng() % 26) + "'";
+    case BINARY: {
+        const int op = program.style.operators[m_rng() % program.style.operators.size()];
+        return randomExpression(program, depth - 1) + " " + BINARY_OPERATORS[op] + " " +
+               randomExpression(program, depth - 1);
+    }
+    case PARENS:
+        return "(" + randomExpression(program, depth - 1) + ")";
+    case INVOKE:
+        return randomSlot(program) + "(" + randomArguments(program, depth - 1) + ")";
+    case CAST:
+        return "(" + randomType(program) + ")" + randomExpression(program, depth - 1);
+    case UNARY:
+        return UNARY_OPERATORS[m_rng() % UNARY_COUNT] + randomExpression(program, depth - 1);
+    case TERNARY:
+        return "(" + randomExpression(program, depth - 1) + " " + randomComparison(program) + " " +
+               randomExpression(program, depth - 1) + " ? " + randomExpression(program, depth - 1) + " : " +
+               randomExpression(program, depth - 1) + ")";
+    default:
+        return m_rng() % 2 ? "sizeof(" + randomType(program) + ")" : "sizeof " + randomSlot(program);
+    }
+}
+
+std::string CorpusGenerator::randomCondition(Program &program)
+{
+    std::string condition = randomExpression(program, 1) + " " + randomComparison(program) + " " +
+                            randomExpression(program, 1);
+    if (m_rng() % 4 == 0) {
+        condition = "!(" + condition + ")";
+    }
+    return condition;
+}
+
+std::string CorpusGenerator::randomBlock(Program &program, int depth, bool inLoop)
+{
+    std::string block = "{";
+    for (int i = 0, count = 1 + m_rng() % 3; i < count; ++i) {
+        block += " " + randomCode(program, depth, inLoop);
+    }
+    return block + " }";
+}
+
+std::string CorpusGenerator::randomCode(Program &program, int depth, bool inLoop)
+{
+    int kind = program.style.statements(m_rng);
+    while ((depth <= 0 && kind >= IF) || (!inLoop && kind == LOOP_EXIT)) {
+        kind = program.style.statements(m_rng);
+    }
+
+    switch (kind) {
+    case DECLARE:
+        return randomType(program) + " " + randomSlot(program) + " = " + randomExpression(program, 2) + ";";
+    case ASSIGN:
+        return randomSlot(program) + " " + randomAssignment(program) + " " +
+               randomExpression(program, 2) + ";";
+    case CALL:
+        return randomSlot(program) + "(" + randomArguments(program, 1) + ");";
+    case STEP:
+        switch (m_rng() % 3) {
+        case 0:
+            return "++" + randomSlot(program) + ";";
+        case 1:
+            return randomSlot(program) + "--;";
+        default:
+            return randomSlot(program) + "[" + randomExpression(program, 1) + "]++;";
+        }
+    case RETURN:
+        return m_rng() % 5 ? "return " + randomExpression(program, 2) + ";" : std::string("return;");
+    case MEMBER:
+        return randomSlot(program) + (m_rng() % 2 ? "." : "->") + randomSlot(program) + " " +
+               randomAssignment(program) + " " + randomExpression(program, 1) + ";";
+    case POINTER:
+        if (m_rng() % 2) {
+            return randomType(program) + " *" + randomSlot(program) + " = &" + randomSlot(program) + ";";
+        }
+        return "*" + randomSlot(program) + " = " + randomExpression(program, 1) + ";";
+    case ARRAY: {
+        std::string code = "static const " + randomType(program) + " " + randomSlot(program) + "[] = {";
+        for (int i = 0, count = 2 + m_rng() % 6; i < count; ++i) {
+            code += (i > 0 ? ", " : "") + std::to_string(m_rng() % 256);
+        }
+        return code + "};";
+    }
+    case PRINT:
+        switch (m_rng() % 3) {
+        case 0:
+            return std::string("printf(") + FORMATS[m_rng() % FORMAT_COUNT] + ", " +
+                   randomExpression(program, 1) + ");";
+        case 1:
+            return std::string("fprintf(stderr, ") + FORMATS[m_rng() % FORMAT_COUNT] + ", " +
+                   randomSlot(program) + ", " + randomExpression(program, 1) + ");";
+        default:
+            return std::string("puts(") + FORMATS[m_rng() % FORMAT_COUNT] + ");";
+        }
+    case SIZEOF:
+        if (m_rng() % 2) {
+            return "memset(" + randomSlot(program) + ", 0, sizeof(" + randomType(program) + ") * " +
+                   randomExpression(program, 1) + ");";
+        }
+        return randomSlot(program) + " = sizeof " + randomSlot(program) + " / sizeof(" + randomType(program) + ");";
+    case SELECT:
+        return randomSlot(program) + " = " + randomCondition(program) + " ? " + randomExpression(program, 1) +
+               " : " + randomExpression(program, 1) + ";";
+    case LOOP_EXIT:
+        switch (m_rng() % 3) {
+        case 0:
+            return "break;";
+        case 1:
+            return "continue;";
+        default:
+            return "if (" + randomCondition(program) + ") break;";
+        }
+    case IF: {
+        std::string code = "if (" + randomCondition(program) + ") " + randomBlock(program, depth - 1, inLoop);
+        switch (m_rng() % 3) {
+        case 0:
+            code += " else " + randomBlock(program, depth - 1, inLoop);
+            break;
+        case 1:
+            code += " else if (" + randomCondition(program) + ") " + randomBlock(program, depth - 1, inLoop);
+            break;
+        }
+        return code;
+    }
+    case WHILE:
+        return "while (" + randomCondition(program) + ") " + randomBlock(program, depth - 1, true);
+    case FOR: {
+        const std::string counter = randomSlot(program);
+        return "for (" + randomType(program) + " " + counter + " = 0; " + counter + " < " +
+               randomExpression(program, 1) + "; ++" + counter + ") " + randomBlock(program, depth - 1, true);
+    }
+    case DO_WHILE:
+        return "do " + randomBlock(program, depth - 1, true) + " while (" + randomCondition(program) + ");";
+    default: {
+        std::string code = "switch (" + randomExpression(program, 1) + ") {";
+        for (int i = 0, count = 1 + m_rng() % 4; i < count; ++i) {
+            code += " case " + std::to_string(m_rng() % 64) + ": " + randomCode(program, depth - 1, inLoop) +
+                    " break;";
+        }
+        if (m_rng() % 2) {
+            code += " default: " + randomCode(program, depth - 1, inLoop);
+        }
+        return code + " }";
+    }
+    }
+}
+
+CorpusGenerator::Statement CorpusGenerator::randomStatement(Program &program)
+{
+    return Statement{randomCode(program, 1 + m_rng() % 2, false)};
+}
+
+CorpusGenerator::Program CorpusGenerator::randomProgram(size_t size)
+{
+    Program program;
+    program.style = randomStyle();
+    program.nameCount = 16 + m_rng() % 11;
+    for (int i = 0; i < program.nameCount; ++i) {
+        program.names.push_back(randomName());
+    }
+
+    // Estimated from the statements themselves, which vary in length with
+    // the style; every placeholder renders as a name of about 11 bytes
+    size_t estimated = 0;
+    while (estimated < size) {
+        Function function;
+        function.name = static_cast<int>(m_rng() % program.nameCount);
+        function.returnType = program.style.types[m_rng() % program.style.types.size()];
+        for (int i = 0, count = m_rng() % 4; i < count; ++i) {
+            function.params.push_back(static_cast<int>(m_rng() % program.nameCount));
+        }
+        const size_t statements = 4 + m_rng() % 12;
+        for (size_t i = 0; i < statements; ++i) {
+            function.body.push_back(randomStatement(program));
+            const std::string &code = function.body.back().code;
+            estimated += code.size() + 9 * std::count(code.begin(), code.end(), '$') + 5;
+        }
+        estimated += 60;
+        program.functions.push_back(std::move(function));
+    }
+    return program;
+}
+
+CorpusGenerator::Program CorpusGenerator::copyProgram(const Program &original)
+{
+    Program copy = original;
+    std::bernoulli_distribution rename(m_options.renameRate);
+    std::bernoulli_distribution reorder(m_options.reorderRate);
+    std::bernoulli_distribution rewrite(m_options.rewriteRate);
+
+    for (auto &name : copy.names) {
+        if (rename(m_rng)) {
+            name = randomName();
+        }
+    }
+
+    for (size_t i = 0; i < copy.functions.size(); ++i) {
+        if (reorder(m_rng)) {
+            std::swap(copy.functions[i], copy.functions[m_rng() % copy.functions.size()]);
+        }
+    }
+
+    for (auto &function : copy.functions) {
+        for (auto &statement : function.body) {
+            if (rewrite(m_rng)) {
+                statement = randomStatement(copy);
+            }
+        }
+    }
+    return copy;
+}
+
+std::string CorpusGenerator::render(const Program &program, bool insertComments)
+{
+    std::bernoulli_distribution comment(insertComments ? m_options.commentRate : 0.0);
+    std::string out = "#include <stdio.h>\n\n";
+
+    for (const auto &function : program.functions) {
+        out += std::string(TYPES[function.returnType]) + " " + program.names[function.name] + "(";
+        for (size_t i = 0; i < function.params.size(); ++i) {
+            out += i > 0 ? ", " : "";
+            out += std::string(TYPES[program.style.types[i % program.style.types.size()]]) + " " +
+                   program.names[function.params[i]];
+        }
+        out += function.params.empty() ? "void)" : ")";
+        out += program.style.braceOnOwnLine ? "\n{\n" : " {\n";
+
+        for (const auto &statement : function.body) {
+            if (comment(m_rng)) {
+                out += "    ";
+                out += COMMENTS[m_rng() % COMMENT_COUNT];
+                out += '\n';
+            }
+
+            out += "    ";
+            for (size_t i = 0; i < statement.code.size(); ++i) {
+                if (statement.code[i] == '$') {
+                    out += program.names[statement.code[++i] - 'a'];
+                } else {
+                    out += statement.code[i];
+                }
+            }
+            out += '\n';
+        }
+        out += "}\n\n";
+    }
+    return out;
+}
+
+std::string CorpusGenerator::commentHeavy(size_t size)
+{
+    std::string out;
+    while (out.size() < size) {
+        out += "/* ";
+        out += COMMENTS[m_rng() % COMMENT_COUNT];
+        out += " */\n";
+        out += COMMENTS[m_rng() % COMMENT_COUNT];
+        out += "\nx = 1;\n";
+    }
+    return out;
+}
+
+std::string CorpusGenerator::literalHeavy(size_t size)
+{
+    std::string out;
+    while (out.size() < size) {
+        out += "puts(\"value \\\"" + randomName() + "\\\" here\"); c = '\\n'; d = 'q';\n";
+    }
+    return out;
+}
+
+std::string CorpusGenerator::numberHeavy(size_t size)
+{
+    std::string out;
+    while (out.size() < size) {
+        out += std::to_string(m_rng() % 100000) + ", " + std::to_string(m_rng() % 1000) + ".25f, " +
+               std::to_string(m_rng()) + "UL,\n";
+    }
+    return out;
+}
+
+std::string CorpusGenerator::whitespaceHeavy(size_t size)
+{
+    std::string out;
+    while (out.size() < size) {
+        out += "        \t  a   =    b ;   \n\n   \t\n";
+    }
+    return out;
+}
+
+std::string CorpusGenerator::identifierHeavy(size_t size)
+{
+    std::string out;
+    while (out.size() < size) {
+        out += "const unsigned " + randomName() + " = static_cast<int>(" + randomName() + ");\n";
+    }
+    return out;
+}
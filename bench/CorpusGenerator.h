@@ -0,0 +1,100 @@
+#ifndef CORPUS_GENERATOR_H
+#define CORPUS_GENERATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Synthetic C-like source files for benchmarks. Every file is built from
+// random functions over a per-file identifier table, in a per-file style
+// that weights statement and expression kinds, types and operators
+// differently, so unrelated files share little beyond the syntax of the
+// language. A share of the files are plagiarized copies of earlier ones,
+// with identifiers renamed, functions reordered, comments inserted and
+// some statements rewritten, so the comparison has realistic work to do
+// and known pairs to find.
+class CorpusGenerator {
+public:
+    struct Options {
+        size_t files = 100;
+        size_t fileSize = 8192;     // approximate bytes per file
+        double copyRate = 0.2;      // share of files copied from another one
+        double renameRate = 0.5;    // share of identifiers renamed in a copy
+        double reorderRate = 0.3;   // chance to move each function of a copy
+        double commentRate = 0.1;   // comments inserted per copied statement
+        double rewriteRate = 0.1;   // statements replaced by new ones
+        uint32_t seed = 1;
+    };
+
+    struct Corpus {
+        std::vector<std::string> files;
+        std::vector<std::pair<size_t, size_t>> copies;  // (original, copy)
+    };
+
+    explicit CorpusGenerator(const Options &options);
+
+    Corpus generate();
+
+    // Workloads that stress one preprocessing stage each
+    std::string commentHeavy(size_t size);
+    std::string literalHeavy(size_t size);
+    std::string numberHeavy(size_t size);
+    std::string whitespaceHeavy(size_t size);
+    std::string identifierHeavy(size_t size);
+
+private:
+    struct Statement {
+        std::string code;  // identifiers as placeholders into Program::names
+    };
+
+    // How one author writes: relative weights of the statement and
+    // expression kinds and the types and operators they reach for. Copies
+    // keep the style of their original, so rewritten statements blend in.
+    struct Style {
+        std::discrete_distribution<int> statements;
+        std::discrete_distribution<int> expressions;
+        std::vector<int> types;      // indices into the type table
+        std::vector<int> operators;  // indices into the operator tables
+        std::vector<int> assignments;
+        std::vector<int> comparisons;
+        bool braceOnOwnLine = false;
+    };
+
+    struct Function {
+        int name;
+        int returnType;
+        std::vector<int> params;
+        std::vector<Statement> body;
+    };
+
+    struct Program {
+        Style style;
+        int nameCount;
+        std::vector<std::string> names;
+        std::vector<Function> functions;
+    };
+
+    Style randomStyle();
+    Program randomProgram(size_t size);
+    Program copyProgram(const Program &original);
+    Statement randomStatement(Program &program);
+    std::string randomCode(Program &program, int depth, bool inLoop);
+    std::string randomBlock(Program &program, int depth, bool inLoop);
+    std::string randomCondition(Program &program);
+    std::string randomExpression(Program &program, int depth);
+    std::string randomArguments(Program &program, int depth);
+    std::string randomType(const Program &program);
+    std::string randomSlot(const Program &program);
+    const char *randomAssignment(const Program &program);
+    const char *randomComparison(const Program &program);
+    std::string randomName();
+    std::string render(const Program &program, bool insertComments);
+
+    Options m_options;
+    std::mt19937 m_rng;
+};
+
+#endif // CORPUS_GENERATOR_H
@@ -0,0 +1,440 @@
+#include "CorpusGenerator.h"
+#include "ComparisonEngine.h"
+#include "Preprocessor.h"
+#include "Rabin_karp.h"
+#include "WorkStealingPool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Benchmark suite: micro benchmarks of the preprocessing, hashing,
+// intersection and match extraction kernels, and end-to-end runs of the
+// comparison over a generated corpus. Throughput is reported per run so
+// results can be compared across releases; --csv gives machine-readable
+// output.
+
+namespace {
+
+struct Settings {
+    size_t files = 100;
+    size_t fileSize = 8192;
+    double copyRate = 0.2;
+    size_t threads = 0;
+    uint32_t seed = 1;
+    double minTime = 0.5;  // seconds per micro benchmark
+    bool micro = true;
+    bool macro = true;
+    bool csv = false;
+};
+
+// Results are folded into this so the compiler cannot drop the work
+volatile size_t g_sink = 0;
+
+double peakRssMegabytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+    }
+    return 0.0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / (1024.0 * 1024.0);  // bytes
+#else
+    return usage.ru_maxrss / 1024.0;  // kilobytes
+#endif
+#endif
+}
+
+class Reporter {
+public:
+    explicit Reporter(bool csv) : m_csv(csv)
+    {
+        if (m_csv) {
+            std::printf("benchmark,seconds_per_run,throughput,unit,peak_rss_mb\n");
+        } else {
+            std::printf("%-36s %14s %16s %12s\n", "benchmark", "time/run", "throughput", "peak RSS");
+        }
+    }
+
+    // amount is what one run processes, in unit (bytes, pairs, ...)
+    void report(const std::string &name, double seconds, double amount, const char *unit)
+    {
+        const double rate = seconds > 0 ? amount / seconds : 0.0;
+        if (m_csv) {
+            std::printf("%s,%.9f,%.3f,%s/s,%.1f\n", name.c_str(), seconds, rate, unit, peakRssMegabytes());
+            return;
+        }
+
+        char time[32];
+        if (seconds < 1e-3) {
+            std::snprintf(time, sizeof(time), "%.2f us", seconds * 1e6);
+        } else if (seconds < 1.0) {
+            std::snprintf(time, sizeof(time), "%.2f ms", seconds * 1e3);
+        } else {
+            std::snprintf(time, sizeof(time), "%.2f s", seconds);
+        }
+
+        // Byte rates in MB/s, everything else as given
+        char throughput[48];
+        if (std::strcmp(unit, "bytes") == 0) {
+            std::snprintf(throughput, sizeof(throughput), "%.1f MB/s", rate / 1e6);
+        } else {
+            std::snprintf(throughput, sizeof(throughput), "%.3g %s/s", rate, unit);
+        }
+        std::printf("%-36s %14s %16s %9.1f MB\n", name.c_str(), time, throughput, peakRssMegabytes());
+    }
+
+    void note(const std::string &text)
+    {
+        std::printf(m_csv ? "# %s\n" : "  %s\n", text.c_str());
+    }
+
+private:
+    bool m_csv;
+};
+
+// Mean time of one call, after a warm-up call, over at least minTime
+double timeIt(double minTime, const std::function<void()> &run)
+{
+    using Clock = std::chrono::steady_clock;
+    run();
+
+    size_t iterations = 0;
+    const auto start = Clock::now();
+    double elapsed = 0.0;
+    do {
+        run();
+        ++iterations;
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    } while (elapsed < minTime);
+    return elapsed / iterations;
+}
+
+double timeOnce(const std::function<void()> &run)
+{
+    const auto start = std::chrono::steady_clock::now();
+    run();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Sorted set of n distinct values, a fraction of them taken from base
+std::vector<long long> makeSet(std::mt19937_64 &rng, size_t n, const std::vector<long long> &base, double shared)
+{
+    std::set<long long> values;
+    for (size_t i = 0; i < base.size() && values.size() < n * shared; ++i) {
+        values.insert(base[i]);
+    }
+    while (values.size() < n) {
+        values.insert(static_cast<long long>(rng() >> 3));
+    }
+    return std::vector<long long>(values.begin(), values.end());
+}
+
+void runMicro(const Settings &settings, Reporter &reporter)
+{
+    CorpusGenerator::Options corpusOptions;
+    corpusOptions.files = 64;
+    corpusOptions.fileSize = 16384;
+    corpusOptions.seed = settings.seed;
+    CorpusGenerator generator(corpusOptions);
+
+    const size_t size = 1 << 20;
+    std::string mixed;
+    for (const auto &file : generator.generate().files) {
+        mixed += file;
+    }
+    mixed.resize(std::min(mixed.size(), size));
+
+    // The stages run fused in one pass, so each workload leans on one stage
+    const std::pair<const char *, std::string> workloads[] = {
+        {"preprocess/comments", generator.commentHeavy(size)},
+        {"preprocess/literals", generator.literalHeavy(size)},
+        {"preprocess/numbers", generator.numberHeavy(size)},
+        {"preprocess/whitespace", generator.whitespaceHeavy(size)},
+        {"preprocess/identifiers", generator.identifierHeavy(size)},
+        {"preprocess/mixed", mixed},
+    };
+
+    Preprocessor preprocessor;
+    std::string processed;
+    for (const auto &workload : workloads) {
+        const double seconds = timeIt(settings.minTime, [&]() {
+            preprocessor.preprocess(workload.second, processed);
+            g_sink += processed.size();
+        });
+        reporter.report(workload.first, seconds, workload.second.size(), "bytes");
+    }
+
+    const double tokenizeSeconds = timeIt(settings.minTime, [&]() {
+        g_sink += preprocessor.tokenize(mixed).size();
+    });
+    reporter.report("tokenize/mixed", tokenizeSeconds, mixed.size(), "bytes");
+
+    // Hash kernel with every k-gram kept, then winnowing on its own
+    preprocessor.preprocess(mixed, processed);
+    const RabinKarp plain(0);
+    for (int k : {5, 8, 16, 32}) {
+        const double seconds = timeIt(settings.minTime, [&]() {
+            g_sink += plain.generateFingerprints(processed, k).size();
+        });
+        reporter.report("hash/k=" + std::to_string(k), seconds, processed.size(), "bytes");
+    }
+
+    std::vector<long long> hashes;
+    for (const auto &fingerprint : plain.generateFingerprints(processed, 5)) {
+        hashes.push_back(fingerprint.hash);
+    }
+    const double winnowSeconds = timeIt(settings.minTime, [&]() {
+        g_sink += RabinKarp::winnow(hashes, 4).size();
+    });
+    reporter.report("winnow/w=4", winnowSeconds, hashes.size(), "hashes");
+
+    // Set intersection, balanced and skewed
+    std::mt19937_64 rng(settings.seed);
+    const auto base = makeSet(rng, 20000, {}, 0.0);
+    const auto balanced = makeSet(rng, 20000, base, 0.5);
+    const auto small = makeSet(rng, 300, base, 0.5);
+    const double balancedSeconds = timeIt(settings.minTime, [&]() {
+        g_sink += RabinKarp::intersectionSize(base, balanced);
+    });
+    reporter.report("intersect/20k x 20k", balancedSeconds, base.size() + balanced.size(), "elements");
+    const double skewedSeconds = timeIt(settings.minTime, [&]() {
+        g_sink += RabinKarp::intersectionSize(small, base);
+    });
+    reporter.report("intersect/300 x 20k", skewedSeconds, small.size() + base.size(), "elements");
+
+    // Match extraction on a plagiarized pair
+    CorpusGenerator::Options pairOptions;
+    pairOptions.files = 2;
+    pairOptions.fileSize = 16384;
+    pairOptions.copyRate = 1.0;
+    pairOptions.seed = settings.seed;
+    const auto pair = CorpusGenerator(pairOptions).generate().files;
+    const RabinKarp winnowing(4);
+    const std::string text1 = preprocessor.preprocess(pair[0]);
+    const std::string text2 = preprocessor.preprocess(pair[1]);
+    const auto fp1 = winnowing.fingerprint(text1, 5);
+    const auto fp2 = winnowing.fingerprint(text2, 5);
+    const double pairBytes = static_cast<double>(fp1.textLength + fp2.textLength);
+
+    const double matchesSeconds = timeIt(settings.minTime, [&]() {
+        g_sink += winnowing.findMatches(fp1, fp2).size();
+    });
+    reporter.report("findMatches/16k pair", matchesSeconds, pairBytes, "bytes");
+    const double runsSeconds = timeIt(settings.minTime, [&]() {
+        g_sink += winnowing.findMatchRuns(fp1, fp2, text1, text2, 8).size();
+    });
+    reporter.report("findMatchRuns/16k pair", runsSeconds, pairBytes, "bytes");
+}
+
+// Share of all pairs a filtered run still scored
+std::string keptLine(const char *filter, size_t kept, double pairs)
+{
+    char line[96];
+    std::snprintf(line, sizeof(line), "%s kept %zu of %.0f pairs (%.1f%%)", filter, kept, pairs,
+                  pairs > 0 ? 100.0 * kept / pairs : 0.0);
+    return line;
+}
+
+void runMacro(const Settings &settings, Reporter &reporter)
+{
+    CorpusGenerator::Options corpusOptions;
+    corpusOptions.files = settings.files;
+    corpusOptions.fileSize = settings.fileSize;
+    corpusOptions.copyRate = settings.copyRate;
+    corpusOptions.seed = settings.seed;
+    const auto corpus = CorpusGenerator(corpusOptions).generate();
+    const size_t n = corpus.files.size();
+    const double pairs = n * (n - 1) / 2.0;
+
+    size_t totalBytes = 0;
+    for (const auto &file : corpus.files) {
+        totalBytes += file.size();
+    }
+    const std::string label = std::to_string(n) + " x " + std::to_string(settings.fileSize / 1024) + "k";
+
+    // Load: preprocess and fingerprint every file in parallel
+    const RabinKarp rk(4);
+    std::vector<std::string> processed(n);
+    std::vector<RabinKarp::FileFingerprints> fingerprints(n);
+    const double loadSeconds = timeOnce([&]() {
+        WorkStealingPool pool(settings.threads);
+        for (size_t i = 0; i < n; ++i) {
+            pool.submit([&, i]() {
+                Preprocessor preprocessor;
+                preprocessor.preprocess(corpus.files[i], processed[i]);
+                fingerprints[i] = rk.fingerprint(processed[i], 5);
+            });
+        }
+        pool.wait();
+    });
+    reporter.report("load/" + label, loadSeconds, totalBytes, "bytes");
+
+    std::vector<ComparisonEngine::Document> documents;
+    for (size_t i = 0; i < n; ++i) {
+        documents.push_back({processed[i], &fingerprints[i]});
+    }
+
+    ComparisonEngine::Options options;
+    options.threads = settings.threads;
+    options.matchRuns = true;
+    options.minRunLength = 8;
+
+    std::vector<ComparisonEngine::PairResult> results;
+    const double compareSeconds = timeOnce([&]() {
+        results = ComparisonEngine(rk, options).compareAll(documents);
+    });
+    reporter.report("compareAll/" + label, compareSeconds, pairs, "pairs");
+
+    const double streamSeconds = timeOnce([&]() {
+        ComparisonEngine engine(rk, options);
+        for (size_t i = 0; i < n; ++i) {
+            g_sink += engine.addDocument(i, documents[i]).size();
+        }
+    });
+    reporter.report("stream/" + label, streamSeconds, pairs, "pairs");
+
+    auto slot = [n](size_t a, size_t b) {
+        if (a > b) std::swap(a, b);
+        return a * n - a * (a + 1) / 2 + (b - a - 1);
+    };
+    std::vector<bool> planted(results.size(), false);
+    for (const auto &copy : corpus.copies) {
+        planted[slot(copy.first, copy.second)] = true;
+    }
+
+    // Size and partial-intersection pruning with a bar just above nearly
+    // all unrelated pairs: the 99th percentile of their similarities in
+    // this corpus, rounded up to a multiple of 0.05
+    std::vector<double> background;
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (!planted[i]) {
+            background.push_back(results[i].similarity);
+        }
+    }
+    double bar = 1.0;
+    if (!background.empty()) {
+        const auto percentile = background.begin() + (background.size() - 1) * 99 / 100;
+        std::nth_element(background.begin(), percentile, background.end());
+        bar = std::min(1.0, std::ceil(*percentile * 20.0) / 20.0);
+    }
+
+    char barLabel[32];
+    std::snprintf(barLabel, sizeof(barLabel), "query-min%.2f/", bar);
+    size_t kept = 0;
+    const double thresholdSeconds = timeOnce([&]() {
+        kept = ComparisonEngine(rk, options).query(documents, {bar, 0}).size();
+    });
+    reporter.report(barLabel + label, thresholdSeconds, pairs, "pairs");
+    reporter.note(keptLine("query", kept, pairs));
+
+    const double topSeconds = timeOnce([&]() {
+        g_sink += ComparisonEngine(rk, options).query(documents, {0.0, 50}).size();
+    });
+    reporter.report("query-top50/" + label, topSeconds, pairs, "pairs");
+
+    options.candidateFilter = true;
+    std::vector<ComparisonEngine::PairResult> candidates;
+    const double lshSeconds = timeOnce([&]() {
+        candidates = ComparisonEngine(rk, options).compareAll(documents);
+    });
+    reporter.report("lsh/" + label, lshSeconds, pairs, "pairs");
+    reporter.note(keptLine("LSH", candidates.size(), pairs));
+
+    // How well the planted copies stand out
+    std::set<std::pair<size_t, size_t>> candidateSet;
+    for (const auto &result : candidates) {
+        candidateSet.emplace(result.file1, result.file2);
+    }
+
+    double copySimilarity = 0.0;
+    size_t found = 0;
+    for (const auto &copy : corpus.copies) {
+        copySimilarity += results[slot(copy.first, copy.second)].similarity;
+        found += candidateSet.count(std::minmax(copy.first, copy.second));
+    }
+    double otherSimilarity = 0.0;
+    for (const auto &result : results) {
+        otherSimilarity += result.similarity;
+    }
+    otherSimilarity -= copySimilarity;
+
+    char line[160];
+    std::snprintf(line, sizeof(line), "%zu planted copies: mean similarity %.3f (others %.3f), %zu of them among the LSH candidates",
+                  corpus.copies.size(), corpus.copies.empty() ? 0.0 : copySimilarity / corpus.copies.size(),
+                  pairs > corpus.copies.size() ? otherSimilarity / (pairs - corpus.copies.size()) : 0.0,
+                  found);
+    reporter.note(line);
+}
+
+bool parseArguments(int argc, char *argv[], Settings &settings)
+{
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--files" && hasValue) {
+            settings.files = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--size" && hasValue) {
+            settings.fileSize = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--copy-rate" && hasValue) {
+            settings.copyRate = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--threads" && hasValue) {
+            settings.threads = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--seed" && hasValue) {
+            settings.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--min-time" && hasValue) {
+            settings.minTime = std::strtod(argv[++i], nullptr);
+        } else if (arg == "--micro") {
+            settings.macro = false;
+        } else if (arg == "--macro") {
+            settings.micro = false;
+        } else if (arg == "--csv") {
+            settings.csv = true;
+        } else {
+            std::fprintf(stderr,
+                         "usage: %s [--micro | --macro] [--files N] [--size BYTES] [--copy-rate R]\n"
+                         "          [--threads N] [--seed N] [--min-time SECONDS] [--csv]\n",
+                         argv[0]);
+            return false;
+        }
+    }
+    return settings.files >= 2 && settings.fileSize > 0;
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    Settings settings;
+    if (!parseArguments(argc, argv, settings)) {
+        return 1;
+    }
+
+    Reporter reporter(settings.csv);
+    if (settings.micro) {
+        runMicro(settings, reporter);
+    }
+    if (settings.macro) {
+        runMacro(settings, reporter);
+    }
+    return 0;
+}
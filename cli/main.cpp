@@ -0,0 +1,399 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include "BaseCodeFilter.h"
+#include "ComparisonEngine.h"
+#include "FingerprintStore.h"
+#include "LoadPipeline.h"
+#include "Preprocessor.h"
+#include "Profiler.h"
+#include "SubmissionCollector.h"
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <memory>
+
+// Headless batch front end: fingerprints the given files, directories and
+// archives and writes the score and match runs of every file pair, or of
+// the pairs a --min-similarity/--top query asks for, as JSON or CSV.
+// Byte-identical files are compared once; their copies are listed as
+// duplicates with similarity 1. Code from the --base files is left out of
+// every score and match. Match positions refer to the preprocessed text,
+// or to token indices in token mode. --stats prints how long each stage
+// took and what it did; --trace saves the stages as a Chrome trace.
+
+namespace {
+
+QTextStream &err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+bool readPositiveInt(const QCommandLineParser &parser, const QString &name, int &value)
+{
+    if (!parser.isSet(name)) {
+        return true;
+    }
+    bool ok = false;
+    const int parsed = parser.value(name).toInt(&ok);
+    if (!ok || parsed <= 0) {
+        err() << "Invalid value for --" << name << ": " << parser.value(name) << "\n";
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+bool readList(const QString &listPath, QStringList &paths)
+{
+    QFile list;
+    bool opened;
+    if (listPath == "-") {
+        opened = list.open(stdin, QIODevice::ReadOnly | QIODevice::Text);
+    } else {
+        list.setFileName(listPath);
+        opened = list.open(QIODevice::ReadOnly | QIODevice::Text);
+    }
+    if (!opened) {
+        err() << "Could not read file list " << listPath << ": " << list.errorString() << "\n";
+        return false;
+    }
+
+    while (!list.atEnd()) {
+        const QString line = QString::fromUtf8(list.readLine()).trimmed();
+        if (!line.isEmpty()) {
+            paths << line;
+        }
+    }
+    return true;
+}
+
+QString csvField(const QString &value)
+{
+    if (!value.contains(',') && !value.contains('"') && !value.contains('\n')) {
+        return value;
+    }
+    QString quoted = value;
+    quoted.replace("\"", "\"\"");
+    return "\"" + quoted + "\"";
+}
+
+void writeJson(QTextStream &out, const QStringList &files, const std::vector<SubmissionCollector::Duplicate> &duplicates,
+               const std::vector<ComparisonEngine::PairResult> &results)
+{
+    QJsonArray fileArray;
+    for (const auto &file : files) {
+        fileArray.append(file);
+    }
+
+    // Pairs are written one by one; a single document for millions of
+    // pairs would have to be held in memory as a whole
+    out << "{\n\"files\": " << QJsonDocument(fileArray).toJson(QJsonDocument::Compact) << ",\n\"pairs\": [";
+    bool first = true;
+    for (const auto &duplicate : duplicates) {
+        QJsonObject pair;
+        pair.insert("file1", duplicate.original);
+        pair.insert("file2", duplicate.file);
+        pair.insert("similarity", 1.0);
+        pair.insert("duplicate", true);
+        pair.insert("runs", QJsonArray());
+
+        out << (first ? "\n" : ",\n") << QJsonDocument(pair).toJson(QJsonDocument::Compact);
+        first = false;
+    }
+    for (const auto &result : results) {
+        if (!result.compared) continue;
+
+        QJsonArray runs;
+        for (const auto &run : result.runs) {
+            runs.append(QJsonArray{static_cast<qint64>(run.start1), static_cast<qint64>(run.start2),
+                                   static_cast<qint64>(run.length)});
+        }
+
+        QJsonObject pair;
+        pair.insert("file1", files[static_cast<int>(result.file1)]);
+        pair.insert("file2", files[static_cast<int>(result.file2)]);
+        pair.insert("similarity", result.similarity);
+        pair.insert("runs", runs);
+
+        out << (first ? "\n" : ",\n") << QJsonDocument(pair).toJson(QJsonDocument::Compact);
+        first = false;
+    }
+    out << "\n]\n}\n";
+}
+
+void writeCsv(QTextStream &out, const QStringList &files, const std::vector<SubmissionCollector::Duplicate> &duplicates,
+              const std::vector<ComparisonEngine::PairResult> &results)
+{
+    out << "file1,file2,similarity,runs\n";
+    // Identical files have no runs listed
+    for (const auto &duplicate : duplicates) {
+        out << csvField(duplicate.original) << ',' << csvField(duplicate.file) << ',' << QString::number(1.0, 'f', 6)
+            << ",\n";
+    }
+    for (const auto &result : results) {
+        if (!result.compared) continue;
+
+        // Runs as start1:start2:length, separated by semicolons
+        QStringList runs;
+        for (const auto &run : result.runs) {
+            runs << QString("%1:%2:%3").arg(run.start1).arg(run.start2).arg(run.length);
+        }
+
+        out << csvField(files[static_cast<int>(result.file1)]) << ','
+            << csvField(files[static_cast<int>(result.file2)]) << ','
+            << QString::number(result.similarity, 'f', 6) << ','
+            << runs.join(";") << '\n';
+    }
+}
+
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("hashtrace-cli");
+    QCoreApplication::setApplicationVersion("0.1");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Compares every pair of the given source files and reports "
+                                     "similarity scores and matching runs.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("paths", "Files, directories or archives (.zip, .tar, .tar.gz) to compare.",
+                                 "[paths...]");
+    parser.addOption({{"l", "list"}, "Read more paths from <file>, one per line (- for stdin).", "file"});
+    parser.addOption({"extensions", "Suffixes of the files taken from directories and archives.", "list",
+                      SubmissionCollector::defaultExtensions().join(',')});
+    parser.addOption({{"k", "kgram"}, "k-gram length (default 5).", "n"});
+    parser.addOption({{"w", "window"}, "Winnowing window (default 4).", "n"});
+    parser.addOption({{"t", "threads"}, "Worker threads (default: one per core).", "n"});
+    parser.addOption({"tokens", "Fingerprint token streams instead of normalized text."});
+    parser.addOption({{"b", "base"}, "Starter code to ignore in every file; may be repeated.", "file"});
+    parser.addOption({"min-run", "Shortest reported match run (default window + k - 1).", "n"});
+    parser.addOption({"lsh", "Only compare pairs proposed by MinHash/LSH."});
+    parser.addOption({"bands", "LSH bands; more find more similar pairs (default 32).", "n"});
+    parser.addOption({"rows", "LSH rows per band; more reject more dissimilar pairs (default 4).", "n"});
+    parser.addOption({"lsh-threshold", "Minimum estimated similarity of an LSH candidate, 0..1 (default 0.2).", "x"});
+    parser.addOption({"min-similarity", "Only report pairs at least this similar, 0..1.", "x"});
+    parser.addOption({"top", "Only report the <n> most similar pairs.", "n"});
+    parser.addOption({"cache", "Fingerprint store to reuse between runs.", "file"});
+    parser.addOption({{"f", "format"}, "Output format: json or csv (default json).", "format", "json"});
+    parser.addOption({{"o", "output"}, "Write to <file> instead of stdout.", "file"});
+    parser.addOption({"stats", "Print stage timings and counters to stderr."});
+    parser.addOption({"trace", "Save the stages as a Chrome/Perfetto trace to <file>.", "file"});
+    parser.process(app);
+
+    int k = 5;
+    int window = 4;
+    int threads = QThread::idealThreadCount();
+    int bands = 32;
+    int rows = 4;
+    int minRun = 0;
+    int top = 0;
+    if (!readPositiveInt(parser, "kgram", k) || !readPositiveInt(parser, "window", window) ||
+        !readPositiveInt(parser, "threads", threads) || !readPositiveInt(parser, "bands", bands) ||
+        !readPositiveInt(parser, "rows", rows) || !readPositiveInt(parser, "min-run", minRun) ||
+        !readPositiveInt(parser, "top", top)) {
+        return 1;
+    }
+    if (minRun == 0) {
+        minRun = window + k - 1;
+    }
+
+    double lshThreshold = 0.2;
+    if (parser.isSet("lsh-threshold")) {
+        bool ok = false;
+        lshThreshold = parser.value("lsh-threshold").toDouble(&ok);
+        if (!ok || lshThreshold < 0.0 || lshThreshold > 1.0) {
+            err() << "Invalid value for --lsh-threshold: " << parser.value("lsh-threshold") << "\n";
+            return 1;
+        }
+    }
+
+    ComparisonEngine::Query query;
+    query.topK = static_cast<size_t>(top);
+    if (parser.isSet("min-similarity")) {
+        bool ok = false;
+        query.minSimilarity = parser.value("min-similarity").toDouble(&ok);
+        if (!ok || query.minSimilarity < 0.0 || query.minSimilarity > 1.0) {
+            err() << "Invalid value for --min-similarity: " << parser.value("min-similarity") << "\n";
+            return 1;
+        }
+    }
+    // A query prunes pairs against the whole set, so it waits for all files
+    const bool isQuery = query.minSimilarity > 0.0 || query.topK > 0;
+
+    const QString format = parser.value("format");
+    if (format != "json" && format != "csv") {
+        err() << "Unknown output format: " << format << "\n";
+        return 1;
+    }
+
+    QStringList paths = parser.positionalArguments();
+    if (parser.isSet("list") && !readList(parser.value("list"), paths)) {
+        return 1;
+    }
+
+    Profiler::setEnabled(parser.isSet("stats") || parser.isSet("trace"));
+    Profiler::setTracing(parser.isSet("trace"));
+
+    SubmissionCollector::Options collectOptions;
+    collectOptions.extensions = parser.value("extensions").split(',', Qt::SkipEmptyParts);
+    collectOptions.threads = threads;
+    SubmissionCollector collector(collectOptions);
+    const bool collected = collector.collect(paths);
+    for (const auto &warning : collector.warnings()) {
+        err() << warning << "\n";
+    }
+    if (!collected) {
+        err() << collector.errorString() << "\n";
+        return 1;
+    }
+    const QStringList files = collector.files();
+    const auto duplicates = collector.duplicates();
+    if (static_cast<size_t>(files.size()) + duplicates.size() < 2) {
+        err() << "At least two files are needed\n";
+        return 1;
+    }
+
+    const bool tokenMode = parser.isSet("tokens");
+    std::unique_ptr<FingerprintStore> store;
+    if (parser.isSet("cache")) {
+        const QByteArray configTag = QString("k=%1;window=%2;mod=%3;base=%4;preprocessor=%5")
+                                         .arg(k)
+                                         .arg(window)
+                                         .arg(RabinKarp::MOD)
+                                         .arg(RabinKarp::BASE)
+                                         .arg(Preprocessor::VERSION)
+                                         .toUtf8();
+        store = std::make_unique<FingerprintStore>(parser.value("cache"), configTag);
+    }
+
+    // Hashes of the starter code are dropped from every file as it loads
+    BaseCodeFilter baseFilter({k, tokenMode});
+    for (const QString &basePath : parser.values("base")) {
+        if (!baseFilter.addFile(basePath)) {
+            err() << baseFilter.errorString() << "\n";
+            return 1;
+        }
+    }
+
+    ComparisonEngine::Options options;
+    options.k = k;
+    options.threads = static_cast<size_t>(threads);
+    options.matchRuns = true;
+    options.minRunLength = static_cast<size_t>(minRun);
+    options.candidateFilter = parser.isSet("lsh");
+    options.minHash.bands = static_cast<size_t>(bands);
+    options.minHash.rows = static_cast<size_t>(rows);
+    options.minHash.threshold = lshThreshold;
+
+    std::vector<FileContent> contents(static_cast<size_t>(files.size()));
+    std::vector<QString> localPaths(contents.size());
+    std::vector<int> pending(contents.size());
+    for (int i = 0; i < files.size(); ++i) {
+        contents[i].path = files[i];
+        localPaths[i] = files[i];
+        pending[i] = i;
+    }
+
+    std::vector<ComparisonEngine::PairResult> results;
+    try {
+        // Without LSH or a query every file is compared while the rest are
+        // loading
+        const bool streaming = !options.candidateFilter && !isQuery;
+        ComparisonEngine engine(RabinKarp(window), options);
+        auto compareFile = [&](int index) {
+            if (!streaming) return;
+            const FileContent &fc = contents[index];
+            auto pairResults = engine.addDocument(static_cast<size_t>(index),
+                                                  {fc.processedContent, &fc.fingerprints,
+                                                   fc.tokens.empty() ? nullptr : &fc.tokens});
+            std::move(pairResults.begin(), pairResults.end(), std::back_inserter(results));
+        };
+
+        LoadPipeline::Options loadOptions;
+        loadOptions.k = k;
+        loadOptions.windowSize = window;
+        loadOptions.tokenMode = tokenMode;
+        loadOptions.processors = threads;
+        LoadPipeline pipeline(loadOptions, store.get());
+        pipeline.setBaseFilter(&baseFilter);
+        if (!pipeline.run(contents, localPaths, pending, {}, compareFile)) {
+            err() << pipeline.errorString() << "\n";
+            return 1;
+        }
+
+        if (!streaming) {
+            std::vector<ComparisonEngine::Document> documents;
+            documents.reserve(contents.size());
+            for (const auto &fc : contents) {
+                documents.push_back({fc.processedContent, &fc.fingerprints, fc.tokens.empty() ? nullptr : &fc.tokens});
+            }
+            // Query results come best first
+            results = isQuery ? engine.query(documents, query) : engine.compareAll(documents);
+        } else {
+            std::sort(results.begin(), results.end(), [](const auto &a, const auto &b) {
+                return a.file1 != b.file1 ? a.file1 < b.file1 : a.file2 < b.file2;
+            });
+        }
+    } catch (const std::exception &e) {
+        err() << "Processing error: " << e.what() << "\n";
+        return 1;
+    }
+
+    if (store) {
+        store->save();
+    }
+
+    for (const auto &result : results) {
+        if (!result.compared) {
+            err() << "Could not compare " << files[static_cast<int>(result.file1)] << " and "
+                  << files[static_cast<int>(result.file2)] << ": " << QString::fromStdString(result.error) << "\n";
+        }
+    }
+
+    QFile output;
+    bool opened;
+    if (parser.isSet("output")) {
+        output.setFileName(parser.value("output"));
+        opened = output.open(QIODevice::WriteOnly | QIODevice::Text);
+    } else {
+        opened = output.open(stdout, QIODevice::WriteOnly | QIODevice::Text);
+    }
+    if (!opened) {
+        err() << "Could not write " << parser.value("output") << ": " << output.errorString() << "\n";
+        return 1;
+    }
+
+    QTextStream out(&output);
+    {
+        Profiler::Scope scope(Profiler::Marshalling);
+        if (format == "csv") {
+            writeCsv(out, files, duplicates, results);
+        } else {
+            writeJson(out, files, duplicates, results);
+        }
+        out.flush();
+    }
+    Profiler::add(Profiler::ResultsPublished, results.size() + duplicates.size());
+
+    if (parser.isSet("trace")) {
+        std::string error;
+        if (!Profiler::writeTrace(parser.value("trace").toStdString(), &error)) {
+            err() << "Could not write the trace: " << QString::fromStdString(error) << "\n";
+            return 1;
+        }
+    }
+    if (parser.isSet("stats")) {
+        err() << QString::fromStdString(Profiler::summary());
+    }
+    return 0;
+}
@@ -1,6 +1,6 @@
 #include "filereader.h"
+#include "SourceFile.h"
 #include <QFile>
-#include <QTextStream>
 #include <QUrl>
 #include <QFileInfo>
 #include <QMimeDatabase>
@@ -31,16 +31,15 @@ QString FileReader::readFile(const QString &fileUrl) {
         return "";
     }
 
-    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QString error = "Failed to open: " + file.errorString();
+    SourceFile source;
+    if (!source.open(localPath)) {
+        QString error = "Failed to open: " + source.errorString();
         emit errorOccurred(error);
         return "";
     }
 
-    QTextStream in(&file);
-    in.setAutoDetectUnicode(true);
-    QString content = in.readAll();
-    file.close();
+    // Decoded straight from the mapped bytes, once
+    QString content = source.toString();
 
     if (content.isEmpty()) {
         qWarning() << "Warning: File is empty:" << localPath;
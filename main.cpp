@@ -4,6 +4,7 @@
 #include <QDebug>
 #include "backend.h"
 #include "filereader.h"
+#include "sourceviewmodel.h"
 
 int main(int argc, char *argv[]) {
     qputenv("QML_XHR_ALLOW_FILE_READ", "1");
@@ -13,6 +14,9 @@ int main(int argc, char *argv[]) {
 
     // Register C++ types
     qmlRegisterType<Backend>("com.company.backend", 1, 0, "Backend");
+    qmlRegisterUncreatableType<ResultModel>("com.company.backend", 1, 0, "ResultModel",
+                                            "ResultModel is provided by Backend.results");
+    qmlRegisterType<SourceViewModel>("com.company.backend", 1, 0, "SourceViewModel");
     qmlRegisterType<FileReader>("com.company.filereader", 1, 0, "FileReader");
 
     QQmlApplicationEngine engine;
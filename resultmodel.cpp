@@ -0,0 +1,171 @@
+#include "resultmodel.h"
+#include <algorithm>
+#include <iterator>
+#include <numeric>
+
+namespace {
+// Queued batches are merged at most this often
+constexpr int FLUSH_INTERVAL_MS = 100;
+
+// Highest score first; ties in path order so the list is stable
+bool ranksBefore(const ResultModel::Entry &a, const ResultModel::Entry &b)
+{
+    if (a.score != b.score) return a.score > b.score;
+    if (a.file1 != b.file1) return a.file1 < b.file1;
+    return a.file2 < b.file2;
+}
+}
+
+ResultModel::ResultModel(QObject *parent) : QAbstractListModel(parent)
+{
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FLUSH_INTERVAL_MS);
+    connect(&m_flushTimer, &QTimer::timeout, this, &ResultModel::flush);
+}
+
+int ResultModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(m_entries.size());
+}
+
+QVariant ResultModel::data(const QModelIndex &index, int role) const
+{
+    if (!checkIndex(index, CheckIndexOption::IndexIsValid | CheckIndexOption::ParentIsInvalid)) {
+        return QVariant();
+    }
+
+    const Entry &entry = m_entries[static_cast<size_t>(index.row())];
+    switch (role) {
+    case File1Role:
+        return entry.file1;
+    case File2Role:
+        return entry.file2;
+    case ScoreRole:
+        return entry.score;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> ResultModel::roleNames() const
+{
+    return {
+        {File1Role, "file1"},
+        {File2Role, "file2"},
+        {ScoreRole, "score"},
+    };
+}
+
+void ResultModel::addResults(std::vector<Entry> batch)
+{
+    if (batch.empty()) return;
+    if (m_pending.empty()) {
+        m_pending = std::move(batch);
+    } else {
+        std::move(batch.begin(), batch.end(), std::back_inserter(m_pending));
+    }
+    if (!m_flushTimer.isActive()) {
+        m_flushTimer.start();
+    }
+}
+
+void ResultModel::flush()
+{
+    m_flushTimer.stop();
+    std::vector<Entry> pending;
+    pending.swap(m_pending);
+    mergeResults(std::move(pending));
+}
+
+void ResultModel::mergeResults(std::vector<Entry> batch)
+{
+    if (batch.empty()) return;
+    std::sort(batch.begin(), batch.end(), ranksBefore);
+
+    const int first = static_cast<int>(m_entries.size());
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(batch.size()) - 1);
+    std::move(batch.begin(), batch.end(), std::back_inserter(m_entries));
+    endInsertRows();
+    emit countChanged();
+
+    // Nothing to move when the whole batch ranks below the existing rows
+    if (first == 0 || !ranksBefore(m_entries[first], m_entries[first - 1])) {
+        return;
+    }
+
+    // Merge the sorted batch into place as one layout change, like a sort
+    emit layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+
+    std::vector<int> order(m_entries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::inplace_merge(order.begin(), order.begin() + first, order.end(), [this](int a, int b) {
+        return ranksBefore(m_entries[a], m_entries[b]);
+    });
+
+    std::vector<Entry> merged;
+    merged.reserve(m_entries.size());
+    std::vector<int> newRow(order.size());
+    for (size_t row = 0; row < order.size(); ++row) {
+        merged.push_back(std::move(m_entries[order[row]]));
+        newRow[order[row]] = static_cast<int>(row);
+    }
+    m_entries = std::move(merged);
+
+    const QModelIndexList from = persistentIndexList();
+    QModelIndexList to;
+    to.reserve(from.size());
+    for (const QModelIndex &index : from) {
+        to.append(this->index(newRow[index.row()], index.column()));
+    }
+    changePersistentIndexList(from, to);
+
+    emit layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void ResultModel::replaceResults(const QStringList &files, std::vector<Entry> batch)
+{
+    flush();
+
+    auto involved = [&files](const Entry &entry) {
+        return files.contains(entry.file1) || files.contains(entry.file2);
+    };
+
+    // Remove from the end in contiguous blocks, so the rows in between keep
+    // their views' state
+    int end = static_cast<int>(m_entries.size());
+    while (end > 0) {
+        while (end > 0 && !involved(m_entries[end - 1])) --end;
+        int begin = end;
+        while (begin > 0 && involved(m_entries[begin - 1])) --begin;
+        if (begin == end) break;
+
+        beginRemoveRows(QModelIndex(), begin, end - 1);
+        m_entries.erase(m_entries.begin() + begin, m_entries.begin() + end);
+        endRemoveRows();
+        end = begin;
+    }
+    emit countChanged();
+
+    mergeResults(std::move(batch));
+}
+
+void ResultModel::clear()
+{
+    m_flushTimer.stop();
+    m_pending.clear();
+    if (m_entries.empty()) return;
+    beginResetModel();
+    m_entries.clear();
+    endResetModel();
+    emit countChanged();
+}
+
+double ResultModel::averageScore() const
+{
+    if (m_entries.empty()) return 0.0;
+    double total = 0.0;
+    for (const Entry &entry : m_entries) {
+        total += entry.score;
+    }
+    return total / m_entries.size();
+}
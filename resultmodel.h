@@ -0,0 +1,64 @@
+#ifndef RESULTMODEL_H
+#define RESULTMODEL_H
+
+#include <QAbstractListModel>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+#include <vector>
+
+// Compared pairs, highest similarity first. Results arrive in batches while
+// a comparison is still running; batches are collected for a moment and
+// then merged into place together, so views keep their scroll position and
+// selection and a stream of small batches costs one merge per interval
+// rather than one per batch. Only the
+// roles the result list shows are exposed; match details are computed by
+// Backend::requestMatchDetail() when a row is opened.
+class ResultModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+
+public:
+    enum Roles {
+        File1Role = Qt::UserRole + 1,
+        File2Role,
+        ScoreRole
+    };
+
+    struct Entry {
+        QString file1;
+        QString file2;
+        double score = 0.0;  // percent
+    };
+
+    explicit ResultModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    // Queues batch; it shows up with the next merge
+    void addResults(std::vector<Entry> batch);
+    // Drops the rows involving any of files, then adds batch in their place
+    // right away, together with any queued rows
+    void replaceResults(const QStringList &files, std::vector<Entry> batch);
+    // Merges the queued rows now
+    void flush();
+    void clear();
+
+    // Mean score of all rows, in percent
+    double averageScore() const;
+
+signals:
+    void countChanged();
+
+private:
+    void mergeResults(std::vector<Entry> batch);
+
+    std::vector<Entry> m_entries;
+    std::vector<Entry> m_pending;
+    QTimer m_flushTimer;
+};
+
+#endif // RESULTMODEL_H
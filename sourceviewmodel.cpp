@@ -0,0 +1,194 @@
+#include "sourceviewmodel.h"
+#include "SourceFile.h"
+#include <QUrl>
+#include <QVariantMap>
+#include <algorithm>
+
+namespace {
+// Escapes text for a RichText Text item, keeping spaces and tabs
+void appendEscaped(QString &out, QStringView text)
+{
+    for (QChar c : text) {
+        switch (c.unicode()) {
+        case '<': out += QLatin1String("&lt;"); break;
+        case '>': out += QLatin1String("&gt;"); break;
+        case '&': out += QLatin1String("&amp;"); break;
+        case ' ': out += QLatin1String("&nbsp;"); break;
+        case '\t': out += QLatin1String("&nbsp;&nbsp;&nbsp;&nbsp;"); break;
+        default: out += c; break;
+        }
+    }
+}
+}
+
+SourceViewModel::SourceViewModel(QObject *parent) : QAbstractListModel(parent) {}
+
+int SourceViewModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(m_lineStarts.size());
+}
+
+QVariant SourceViewModel::data(const QModelIndex &index, int role) const
+{
+    if (!checkIndex(index, CheckIndexOption::IndexIsValid | CheckIndexOption::ParentIsInvalid)) {
+        return QVariant();
+    }
+
+    const int line = index.row();
+    switch (role) {
+    case LineNumberRole:
+        return line + 1;
+    case TextRole:
+        return styledLine(line);
+    case HighlightedRole: {
+        auto it = std::upper_bound(m_highlights.begin(), m_highlights.end(), m_lineStarts[line],
+                                   [](int position, const Interval &interval) { return position < interval.end; });
+        return it != m_highlights.end() && it->begin < lineEnd(line);
+    }
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> SourceViewModel::roleNames() const
+{
+    return {
+        {LineNumberRole, "lineNumber"},
+        {TextRole, "text"},
+        {HighlightedRole, "highlighted"},
+    };
+}
+
+QString SourceViewModel::source() const
+{
+    return m_source;
+}
+
+void SourceViewModel::setSource(const QString &source)
+{
+    if (source == m_source) return;
+    m_source = source;
+
+    beginResetModel();
+    m_text.clear();
+    m_lineStarts.clear();
+    m_highlights.clear();
+
+    if (!source.isEmpty()) {
+        const QString localPath = source.startsWith("file://") ? QUrl(source).toLocalFile() : source;
+        SourceFile file;
+        if (file.open(localPath)) {
+            m_text = file.toString();
+            m_lineStarts.push_back(0);
+            for (qsizetype i = m_text.indexOf(QLatin1Char('\n')); i >= 0;
+                 i = m_text.indexOf(QLatin1Char('\n'), i + 1)) {
+                m_lineStarts.push_back(static_cast<int>(i + 1));
+            }
+            // A trailing newline does not start another line
+            if (m_lineStarts.size() > 1 && m_lineStarts.back() == m_text.size()) {
+                m_lineStarts.pop_back();
+            }
+        } else {
+            emit errorOccurred(tr("Failed to open: %1").arg(file.errorString()));
+        }
+    }
+
+    endResetModel();
+    emit sourceChanged();
+    emit countChanged();
+}
+
+QColor SourceViewModel::highlightColor() const
+{
+    return m_highlightColor;
+}
+
+void SourceViewModel::setHighlightColor(const QColor &color)
+{
+    if (color == m_highlightColor) return;
+    m_highlightColor = color;
+    restyle();
+    emit highlightColorChanged();
+}
+
+void SourceViewModel::setHighlights(const QVariantList &ranges)
+{
+    m_highlights.clear();
+    m_highlights.reserve(static_cast<size_t>(ranges.size()));
+    for (const QVariant &range : ranges) {
+        const QVariantMap map = range.toMap();
+        const int begin = map.value("start").toInt();
+        const int end = map.value("end").toInt();
+        if (begin < end) {
+            m_highlights.push_back({begin, end});
+        }
+    }
+
+    // Overlapping runs merge, so a line's intervals are one sorted slice
+    std::sort(m_highlights.begin(), m_highlights.end(),
+              [](const Interval &a, const Interval &b) { return a.begin < b.begin; });
+    size_t merged = 0;
+    for (const Interval &interval : m_highlights) {
+        if (merged > 0 && interval.begin <= m_highlights[merged - 1].end) {
+            m_highlights[merged - 1].end = std::max(m_highlights[merged - 1].end, interval.end);
+        } else {
+            m_highlights[merged++] = interval;
+        }
+    }
+    m_highlights.resize(merged);
+
+    restyle();
+}
+
+void SourceViewModel::clearHighlights()
+{
+    if (m_highlights.empty()) return;
+    m_highlights.clear();
+    restyle();
+}
+
+int SourceViewModel::lineAt(int position) const
+{
+    if (m_lineStarts.empty()) return -1;
+    auto it = std::upper_bound(m_lineStarts.begin(), m_lineStarts.end(), position);
+    return static_cast<int>(std::max<ptrdiff_t>(it - m_lineStarts.begin() - 1, 0));
+}
+
+int SourceViewModel::lineEnd(int line) const
+{
+    // Excludes the newline
+    const size_t next = static_cast<size_t>(line) + 1;
+    return next < m_lineStarts.size() ? m_lineStarts[next] - 1 : static_cast<int>(m_text.size());
+}
+
+QString SourceViewModel::styledLine(int line) const
+{
+    const int begin = m_lineStarts[static_cast<size_t>(line)];
+    const int end = lineEnd(line);
+    const QStringView text = QStringView(m_text).mid(begin, end - begin);
+
+    QString styled;
+    styled.reserve(text.size() + 32);
+    const QString open = QStringLiteral("<span style=\"background-color:%1\">").arg(m_highlightColor.name(QColor::HexArgb));
+
+    int position = begin;
+    auto it = std::upper_bound(m_highlights.begin(), m_highlights.end(), begin,
+                               [](int value, const Interval &interval) { return value < interval.end; });
+    for (; it != m_highlights.end() && it->begin < end; ++it) {
+        const int from = std::max(it->begin, begin);
+        const int to = std::min(it->end, end);
+        appendEscaped(styled, text.mid(position - begin, from - position));
+        styled += open;
+        appendEscaped(styled, text.mid(from - begin, to - from));
+        styled += QLatin1String("</span>");
+        position = to;
+    }
+    appendEscaped(styled, text.mid(position - begin));
+    return styled;
+}
+
+void SourceViewModel::restyle()
+{
+    if (m_lineStarts.empty()) return;
+    emit dataChanged(index(0), index(rowCount() - 1), {TextRole, HighlightedRole});
+}
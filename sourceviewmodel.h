@@ -0,0 +1,72 @@
+#ifndef SOURCEVIEWMODEL_H
+#define SOURCEVIEWMODEL_H
+
+#include <QAbstractListModel>
+#include <QColor>
+#include <QString>
+#include <QVariantList>
+#include <vector>
+
+// One row per line of a source file, for a ListView in the detail dialog.
+// Opening a file only decodes it and records where each line starts; a
+// line is escaped and styled when the view asks for it, so only the
+// visible lines cost anything. Match ranges are positions in the decoded
+// text (as in Backend::matchDetailReady); they are merged into sorted,
+// disjoint intervals and each line finds its own with a binary search.
+class SourceViewModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_PROPERTY(QString source READ source WRITE setSource NOTIFY sourceChanged)
+    Q_PROPERTY(QColor highlightColor READ highlightColor WRITE setHighlightColor NOTIFY highlightColorChanged)
+    Q_PROPERTY(int count READ rowCount NOTIFY countChanged)
+
+public:
+    enum Roles {
+        LineNumberRole = Qt::UserRole + 1,
+        TextRole,        // rich text with the matched parts highlighted
+        HighlightedRole  // whether any part of the line is matched
+    };
+
+    explicit SourceViewModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    QString source() const;
+    void setSource(const QString &source);
+
+    QColor highlightColor() const;
+    void setHighlightColor(const QColor &color);
+
+    // ranges holds {start, end} maps of positions in the file text
+    Q_INVOKABLE void setHighlights(const QVariantList &ranges);
+    Q_INVOKABLE void clearHighlights();
+
+    // Line containing a position in the file text
+    Q_INVOKABLE int lineAt(int position) const;
+
+signals:
+    void sourceChanged();
+    void highlightColorChanged();
+    void countChanged();
+    void errorOccurred(const QString &message);
+
+private:
+    struct Interval {
+        int begin;
+        int end;
+    };
+
+    int lineEnd(int line) const;
+    QString styledLine(int line) const;
+    void restyle();
+
+    QString m_source;
+    QString m_text;
+    std::vector<int> m_lineStarts;
+    std::vector<Interval> m_highlights;
+    QColor m_highlightColor = QColor(255, 215, 0, 110);
+};
+
+#endif // SOURCEVIEWMODEL_H
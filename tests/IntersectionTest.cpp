@@ -0,0 +1,184 @@
+#include "Rabin_karp.h"
+#include <QTest>
+#include <algorithm>
+#include <climits>
+#include <iterator>
+#include <random>
+#include <set>
+#include <vector>
+
+// RabinKarp::intersectionSize() picks a kernel per call: galloping search
+// when one set is at least 32 times larger, otherwise the AVX2 block merge
+// or the scalar merge, and a bounded scalar merge when given a minimum.
+// Every one of them must count what std::set_intersection counts. ctest
+// runs this test twice, the second time with HASHTRACE_NO_AVX2 set, so
+// both merges are covered on machines with AVX2.
+
+namespace {
+
+using Set = std::vector<long long>;
+
+size_t reference(const Set &a, const Set &b)
+{
+    const std::set<long long> left(a.begin(), a.end());
+    const std::set<long long> right(b.begin(), b.end());
+    std::vector<long long> common;
+    std::set_intersection(left.begin(), left.end(), right.begin(), right.end(), std::back_inserter(common));
+    return common.size();
+}
+
+// n distinct sorted values from [-range, range], shared of them taken from
+// base; a small range packs the values densely, so runs of equal and
+// interleaved values are common
+Set makeSet(std::mt19937_64 &rng, size_t n, long long range, const Set &base = {}, size_t shared = 0)
+{
+    std::set<long long> values;
+    for (size_t i = 0; i < base.size() && values.size() < std::min(shared, n); ++i) {
+        values.insert(base[(i * 7919) % base.size()]);
+    }
+    std::uniform_int_distribution<long long> value(-range, range);
+    while (values.size() < n) {
+        values.insert(value(rng));
+    }
+    return Set(values.begin(), values.end());
+}
+
+QByteArray describe(const Set &a, const Set &b)
+{
+    return QByteArray::number(static_cast<qulonglong>(a.size())) + " x " +
+           QByteArray::number(static_cast<qulonglong>(b.size()));
+}
+
+}
+
+class IntersectionTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void emptyInputs();
+    void smallSizes();
+    void skewBoundary();
+    void randomSets();
+    void extremeValues();
+
+private:
+    // Compares every path against the reference, both argument orders,
+    // and the bounded count for minimums around the true size
+    void check(const Set &a, const Set &b);
+};
+
+void IntersectionTest::check(const Set &a, const Set &b)
+{
+    const size_t expected = reference(a, b);
+    QVERIFY2(RabinKarp::intersectionSize(a, b) == expected, describe(a, b).constData());
+    QVERIFY2(RabinKarp::intersectionSize(b, a) == expected, describe(b, a).constData());
+
+    const size_t smaller = std::min(a.size(), b.size());
+    std::vector<size_t> minimums = {0, 1, 2, smaller, smaller + 1};
+    for (size_t delta = 0; delta <= 2; ++delta) {
+        minimums.push_back(expected + delta);
+        if (expected >= delta) {
+            minimums.push_back(expected - delta);
+        }
+    }
+
+    // A count that can reach minimum is exact; one that cannot only has
+    // to stay below it
+    for (const size_t minimum : minimums) {
+        for (const bool swapped : {false, true}) {
+            const size_t bounded = swapped ? RabinKarp::intersectionSize(b, a, minimum)
+                                           : RabinKarp::intersectionSize(a, b, minimum);
+            const QByteArray where = describe(a, b) + ", minimum " + QByteArray::number(static_cast<qulonglong>(minimum)) +
+                                     ", got " + QByteArray::number(static_cast<qulonglong>(bounded)) +
+                                     (swapped ? ", swapped" : "");
+            if (minimum <= expected) {
+                QVERIFY2(bounded == expected, where.constData());
+            } else {
+                QVERIFY2(bounded < minimum && bounded <= expected, where.constData());
+            }
+        }
+    }
+}
+
+void IntersectionTest::emptyInputs()
+{
+    const Set empty;
+    const Set some = {-5, 0, 3, 8};
+    check(empty, empty);
+    check(empty, some);
+    check(some, empty);
+    QCOMPARE(RabinKarp::intersectionSize(empty, some, 0), size_t(0));
+    QCOMPARE(RabinKarp::intersectionSize(some, empty, 1), size_t(0));
+}
+
+// Every size pair up to a few AVX2 blocks, so the vector loop ends at
+// every offset and the scalar tail sees every length
+void IntersectionTest::smallSizes()
+{
+    std::mt19937_64 rng(1);
+    for (size_t na = 0; na <= 13; ++na) {
+        for (size_t nb = 0; nb <= 13; ++nb) {
+            for (int round = 0; round < 8; ++round) {
+                const Set a = makeSet(rng, na, 16);
+                const Set b = makeSet(rng, nb, 16, a, rng() % (na + 1));
+                check(a, b);
+                if (QTest::currentTestFailed()) return;
+            }
+        }
+    }
+}
+
+// Galloping takes over at exactly 32 times the size; both sides of that
+// line must agree
+void IntersectionTest::skewBoundary()
+{
+    std::mt19937_64 rng(2);
+    for (const size_t small : {1, 2, 3, 4, 5, 17, 100}) {
+        for (const size_t large : {small * 31, small * 32 - 1, small * 32, small * 32 + 1, small * 33}) {
+            for (const long long range : {4LL * static_cast<long long>(large), 1LL << 40}) {
+                const Set big = makeSet(rng, large, range);
+                for (const size_t shared : {size_t(0), small / 2, small}) {
+                    const Set few = makeSet(rng, small, range, big, shared);
+                    check(few, big);
+                    if (QTest::currentTestFailed()) return;
+                }
+            }
+        }
+    }
+}
+
+void IntersectionTest::randomSets()
+{
+    std::mt19937_64 rng(3);
+    for (int round = 0; round < 200; ++round) {
+        const size_t na = rng() % 3000;
+        const size_t nb = rng() % 3000;
+        const long long range = (round % 2) ? 2 * static_cast<long long>(na + nb) + 1 : LLONG_MAX / 2;
+        const Set a = makeSet(rng, na, range);
+        const Set b = makeSet(rng, nb, range, a, rng() % (na + 1));
+        check(a, b);
+        if (QTest::currentTestFailed()) return;
+    }
+
+    // Identical sets and disjoint interleaved ones
+    const Set a = makeSet(rng, 1001, 1 << 20);
+    check(a, a);
+    Set odd;
+    Set even;
+    for (long long v = 0; v < 2000; ++v) {
+        (v % 2 ? odd : even).push_back(v);
+    }
+    check(odd, even);
+}
+
+void IntersectionTest::extremeValues()
+{
+    const Set a = {LLONG_MIN, LLONG_MIN + 1, -1, 0, 1, LLONG_MAX - 1, LLONG_MAX};
+    const Set b = {LLONG_MIN, -2, 0, 2, LLONG_MAX};
+    check(a, b);
+    check(a, a);
+    check({LLONG_MIN}, {LLONG_MAX});
+}
+
+QTEST_APPLESS_MAIN(IntersectionTest)
+#include "IntersectionTest.moc"
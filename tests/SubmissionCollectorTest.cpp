@@ -0,0 +1,424 @@
+#include "SubmissionCollector.h"
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Archive readers of SubmissionCollector, fed archives that are built
+// byte by byte below, so every header field a test depends on is visible
+// here rather than hidden in a binary fixture
+
+namespace {
+
+void put16(QByteArray &out, quint16 value)
+{
+    char bytes[2];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 2);
+}
+
+void put32(QByteArray &out, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, 4);
+}
+
+quint32 crc32(const QByteArray &data)
+{
+    quint32 crc = 0xFFFFFFFF;
+    for (const char c : data) {
+        crc ^= static_cast<uchar>(c);
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0u - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// qCompress() writes a 4-byte length, then a zlib stream: a 2-byte header,
+// the raw deflate data zip and gzip want, and a 4-byte checksum
+QByteArray rawDeflate(const QByteArray &data)
+{
+    return qCompress(data).mid(6).chopped(4);
+}
+
+QByteArray gzip(const QByteArray &data)
+{
+    QByteArray out("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\xff", 10);
+    out += rawDeflate(data);
+    put32(out, crc32(data));
+    put32(out, static_cast<quint32>(data.size()));
+    return out;
+}
+
+QByteArray tarHeader(const QByteArray &name, qsizetype size, char type, const QByteArray &prefix = {})
+{
+    QByteArray header(512, '\0');
+    std::memcpy(header.data(), name.constData(), qMin<qsizetype>(name.size(), 100));
+    std::memcpy(header.data() + 100, "0000644", 7);
+    const QByteArray octalSize = QByteArray::number(static_cast<qlonglong>(size), 8).rightJustified(11, '0');
+    std::memcpy(header.data() + 124, octalSize.constData(), 11);
+    header[156] = type;
+    std::memcpy(header.data() + 257, "ustar\0" "00", 8);
+    std::memcpy(header.data() + 345, prefix.constData(), qMin<qsizetype>(prefix.size(), 155));
+
+    std::memset(header.data() + 148, ' ', 8);
+    unsigned checksum = 0;
+    for (const char c : header) {
+        checksum += static_cast<uchar>(c);
+    }
+    const QByteArray octalChecksum = QByteArray::number(checksum, 8).rightJustified(6, '0');
+    std::memcpy(header.data() + 148, octalChecksum.constData(), 6);
+    header[154] = '\0';
+    return header;
+}
+
+QByteArray tarEntry(const QByteArray &name, const QByteArray &content, char type = '0',
+                    const QByteArray &prefix = {})
+{
+    QByteArray entry = tarHeader(name, content.size(), type, prefix) + content;
+    entry.append((512 - content.size() % 512) % 512, '\0');
+    return entry;
+}
+
+QByteArray tarEnd()
+{
+    return QByteArray(1024, '\0');
+}
+
+struct ZipEntry {
+    QByteArray name;
+    QByteArray content;
+    bool deflated = false;
+    bool encrypted = false;
+    qsizetype cut = 0;           // bytes dropped from the end of the entry's data
+    qint64 declaredSize = -1;    // uncompressed size written to the headers, if not the real one
+};
+
+QByteArray zipArchive(const std::vector<ZipEntry> &entries)
+{
+    QByteArray out;
+    QByteArray directory;
+    for (const ZipEntry &entry : entries) {
+        const QByteArray data = (entry.deflated ? rawDeflate(entry.content) : entry.content).chopped(entry.cut);
+        const auto size = static_cast<quint32>(entry.declaredSize < 0 ? entry.content.size() : entry.declaredSize);
+        const quint16 flags = entry.encrypted ? 0x1 : 0x0;
+        const quint16 method = entry.deflated ? 8 : 0;
+        const auto offset = static_cast<quint32>(out.size());
+
+        put32(out, 0x04034b50);
+        put16(out, 20);
+        put16(out, flags);
+        put16(out, method);
+        put32(out, 0);  // time and date
+        put32(out, crc32(entry.content));
+        put32(out, static_cast<quint32>(data.size()));
+        put32(out, size);
+        put16(out, static_cast<quint16>(entry.name.size()));
+        put16(out, 0);
+        out += entry.name;
+        out += data;
+
+        put32(directory, 0x02014b50);
+        put16(directory, 20);
+        put16(directory, 20);
+        put16(directory, flags);
+        put16(directory, method);
+        put32(directory, 0);
+        put32(directory, crc32(entry.content));
+        put32(directory, static_cast<quint32>(data.size()));
+        put32(directory, size);
+        put16(directory, static_cast<quint16>(entry.name.size()));
+        put16(directory, 0);  // extra field
+        put16(directory, 0);  // comment
+        put16(directory, 0);  // disk
+        put16(directory, 0);  // internal attributes
+        put32(directory, 0);  // external attributes
+        put32(directory, offset);
+        directory += entry.name;
+    }
+
+    const auto directoryOffset = static_cast<quint32>(out.size());
+    out += directory;
+    put32(out, 0x06054b50);
+    put16(out, 0);
+    put16(out, 0);
+    put16(out, static_cast<quint16>(entries.size()));
+    put16(out, static_cast<quint16>(entries.size()));
+    put32(out, static_cast<quint32>(directory.size()));
+    put32(out, directoryOffset);
+    put16(out, 0);
+    return out;
+}
+
+}
+
+class SubmissionCollectorTest : public QObject {
+    Q_OBJECT
+
+private slots:
+    void entryPaths_data();
+    void entryPaths();
+    void longNames();
+    void storedAndDeflated();
+    void encryptedEntries();
+    void gzippedTar();
+    void truncated_data();
+    void truncated();
+
+private:
+    // Writes bytes to a file called name and collects it
+    bool collectArchive(const QString &name, const QByteArray &bytes);
+    QByteArray collectedContent(const QString &suffix) const;
+
+    QTemporaryDir m_inputs;
+    std::unique_ptr<SubmissionCollector> m_collector;
+};
+
+bool SubmissionCollectorTest::collectArchive(const QString &name, const QByteArray &bytes)
+{
+    m_collector = std::make_unique<SubmissionCollector>();
+    const QString path = m_inputs.filePath(name);
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(bytes) != bytes.size()) {
+        qWarning("Could not write %s", qPrintable(path));
+        return false;
+    }
+    file.close();
+    return m_collector->collect({path});
+}
+
+QByteArray SubmissionCollectorTest::collectedContent(const QString &suffix) const
+{
+    for (const QString &path : m_collector->files()) {
+        if (path.endsWith(suffix)) {
+            QFile file(path);
+            return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+        }
+    }
+    return QByteArray();
+}
+
+void SubmissionCollectorTest::entryPaths_data()
+{
+    QTest::addColumn<QByteArray>("name");
+    QTest::addColumn<QString>("unpackedAs");  // empty when refused
+
+    QTest::newRow("plain") << QByteArray("main.cpp") << QStringLiteral("main.cpp");
+    QTest::newRow("nested") << QByteArray("src/util/main.cpp") << QStringLiteral("src/util/main.cpp");
+    QTest::newRow("dot segments inside") << QByteArray("src/./lib/../main.cpp") << QStringLiteral("src/main.cpp");
+    QTest::newRow("backslashes") << QByteArray("src\\main.cpp") << QStringLiteral("src/main.cpp");
+    QTest::newRow("parent") << QByteArray("../main.cpp") << QString();
+    QTest::newRow("climbs out after a directory") << QByteArray("src/../../main.cpp") << QString();
+    QTest::newRow("parent with backslashes") << QByteArray("..\\..\\main.cpp") << QString();
+    QTest::newRow("absolute") << QByteArray("/tmp/main.cpp") << QString();
+    QTest::newRow("drive letter") << QByteArray("C:/main.cpp") << QString();
+}
+
+void SubmissionCollectorTest::entryPaths()
+{
+    QFETCH(QByteArray, name);
+    QFETCH(QString, unpackedAs);
+
+    const QByteArray content("int main() { return 0; }\n");
+    const QByteArray tar = tarEntry("marker.cpp", "int marker;\n") + tarEntry(name, content) + tarEnd();
+    QVERIFY2(collectArchive("paths.tar", tar), qPrintable(m_collector->errorString()));
+
+    // The archive is unpacked into a directory of its own below the
+    // collector's scratch directory
+    const QStringList files = m_collector->files();
+    const auto marker = std::find_if(files.begin(), files.end(),
+                                     [](const QString &path) { return path.endsWith("paths.tar/marker.cpp"); });
+    QVERIFY(marker != files.end());
+    const QString archiveDirectory = QFileInfo(*marker).path();
+
+    if (unpackedAs.isEmpty()) {
+        QCOMPARE(files.size(), 1);
+        QCOMPARE(m_collector->warnings().size(), 1);
+        QVERIFY(m_collector->warnings().first().contains("leaves the archive"));
+    } else {
+        QCOMPARE(files.size(), 2);
+        QVERIFY(m_collector->warnings().isEmpty());
+        QVERIFY2(files.contains(archiveDirectory + "/" + unpackedAs), qPrintable(files.join(' ')));
+        QCOMPARE(collectedContent("paths.tar/" + unpackedAs), content);
+    }
+
+    // Nothing may land beside that directory
+    QDirIterator it(QFileInfo(archiveDirectory).path(), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString path = it.next();
+        QVERIFY2(path.startsWith(archiveDirectory + "/"), qPrintable(path));
+    }
+}
+
+void SubmissionCollectorTest::longNames()
+{
+    const QByteArray longName = QByteArray("very/").repeated(30) + "deeply_nested_file.cpp";
+    QVERIFY(longName.size() > 100);
+    const QByteArray content("long name\n");
+    const QByteArray prefixed("short.cpp");
+    const QByteArray prefix = QByteArray("prefix/").repeated(10).chopped(1);
+
+    const QByteArray tar = tarEntry("././@LongLink", longName + '\0', 'L') +
+                           tarEntry(longName.left(100), content) +
+                           tarEntry(prefixed, "ustar prefix\n", '0', prefix) +
+                           tarEntry("after.cpp", "after\n") + tarEnd();
+    QVERIFY2(collectArchive("long.tar", tar), qPrintable(m_collector->errorString()));
+
+    QCOMPARE(m_collector->files().size(), 3);
+    QCOMPARE(collectedContent("/" + QString::fromLatin1(longName)), content);
+    QCOMPARE(collectedContent(QString::fromLatin1("/" + prefix + "/" + prefixed)), QByteArray("ustar prefix\n"));
+    // The long name applies to the next entry only
+    QCOMPARE(collectedContent("long.tar/after.cpp"), QByteArray("after\n"));
+}
+
+void SubmissionCollectorTest::storedAndDeflated()
+{
+    const QByteArray stored("int stored;\n");
+    const QByteArray deflated = QByteArray("int deflated = 1;\n").repeated(200);
+    const QByteArray zip = zipArchive({
+        {"src/", {}},
+        {"src/stored.cpp", stored},
+        {"src/deflated.cpp", deflated, true},
+        {"notes.txt", "not a source file"},
+    });
+    QVERIFY2(collectArchive("mixed.zip", zip), qPrintable(m_collector->errorString()));
+
+    QCOMPARE(collectedContent("src/stored.cpp"), stored);
+#ifdef HASHTRACE_HAVE_ZLIB
+    QCOMPARE(m_collector->files().size(), 2);
+    QCOMPARE(collectedContent("src/deflated.cpp"), deflated);
+    QVERIFY(m_collector->warnings().isEmpty());
+#else
+    QCOMPARE(m_collector->files().size(), 1);
+    QCOMPARE(m_collector->warnings().size(), 1);
+    QVERIFY(m_collector->warnings().first().contains("no zlib"));
+#endif
+}
+
+void SubmissionCollectorTest::encryptedEntries()
+{
+    const QByteArray zip = zipArchive({
+        {"secret.cpp", "scrambled bytes", false, true},
+        {"open.cpp", "int open;\n"},
+    });
+    QVERIFY2(collectArchive("encrypted.zip", zip), qPrintable(m_collector->errorString()));
+
+    QCOMPARE(m_collector->files().size(), 1);
+    QCOMPARE(collectedContent("open.cpp"), QByteArray("int open;\n"));
+    QCOMPARE(m_collector->warnings().size(), 1);
+    QVERIFY(m_collector->warnings().first().contains("encrypted entry secret.cpp"));
+}
+
+void SubmissionCollectorTest::gzippedTar()
+{
+#ifdef HASHTRACE_HAVE_ZLIB
+    const QByteArray content("int packed;\n");
+    QVERIFY2(collectArchive("packed.tgz", gzip(tarEntry("packed.cpp", content) + tarEnd())),
+             qPrintable(m_collector->errorString()));
+    QCOMPARE(m_collector->files().size(), 1);
+    QCOMPARE(collectedContent("packed.cpp"), content);
+#else
+    QSKIP("built without zlib");
+#endif
+}
+
+void SubmissionCollectorTest::truncated_data()
+{
+    QTest::addColumn<QString>("name");
+    QTest::addColumn<QByteArray>("bytes");
+    QTest::addColumn<QString>("error");
+    QTest::addColumn<bool>("needsZlib");
+
+    const QByteArray content = QByteArray("int x = 42;\n").repeated(100);
+    const QByteArray tar = tarEntry("first.cpp", "int first;\n") + tarEntry("cut.cpp", content) + tarEnd();
+    // Cut inside the second entry's data
+    QTest::newRow("tar data") << QStringLiteral("cut.tar") << tar.left(512 * 3 + 100)
+                              << QStringLiteral("truncated tar data") << false;
+
+    QByteArray pastEnd = tarEntry("big.cpp", content) + tarEnd();
+    std::memcpy(pastEnd.data() + 124, "77777777777", 11);
+    QTest::newRow("tar size past the end") << QStringLiteral("size.tar") << pastEnd
+                                           << QStringLiteral("truncated tar data") << false;
+
+    QByteArray notOctal = tarEntry("bad.cpp", content) + tarEnd();
+    std::memcpy(notOctal.data() + 124, "12x4", 4);
+    QTest::newRow("tar size not octal") << QStringLiteral("octal.tar") << notOctal
+                                        << QStringLiteral("unsupported tar header") << false;
+
+    const QByteArray zip = zipArchive({{"a.cpp", content}, {"b.cpp", content, true}});
+    const qsizetype directory = zip.indexOf("PK\x01\x02");
+    const qsizetype secondRecord = zip.indexOf("PK\x01\x02", directory + 4);
+
+    QTest::newRow("zip end record") << QStringLiteral("end.zip") << zip.chopped(10)
+                                    << QStringLiteral("no zip directory found") << false;
+
+    QByteArray directoryPastEnd = zip;
+    qToLittleEndian<quint32>(static_cast<quint32>(zip.size()), directoryPastEnd.data() + zip.size() - 6);
+    QTest::newRow("zip directory") << QStringLiteral("directory.zip") << directoryPastEnd
+                                   << QStringLiteral("corrupt zip directory") << false;
+
+    // Only the start of the entry data is left in front of the directory
+    QByteArray cutData = zip.left(60) + zip.mid(directory);
+    qToLittleEndian<quint32>(60, cutData.data() + cutData.size() - 6);
+    QTest::newRow("zip entry data") << QStringLiteral("data.zip") << cutData
+                                    << QStringLiteral("truncated zip entry a.cpp") << false;
+
+    QByteArray badOffset = zip;
+    qToLittleEndian<quint32>(1, badOffset.data() + directory + 42);
+    QTest::newRow("zip local header") << QStringLiteral("local.zip") << badOffset
+                                      << QStringLiteral("corrupt zip entry a.cpp") << false;
+
+    QByteArray badSecond = zip;
+    qToLittleEndian<quint32>(static_cast<quint32>(zip.size()), badSecond.data() + secondRecord + 42);
+    QTest::newRow("zip second local header") << QStringLiteral("second.zip") << badSecond
+                                             << QStringLiteral("corrupt zip entry b.cpp") << false;
+
+    ZipEntry cutStream{"b.cpp", content, true};
+    cutStream.cut = rawDeflate(content).size() / 2;
+    QTest::newRow("deflate stream") << QStringLiteral("stream.zip") << zipArchive({cutStream})
+                                    << QStringLiteral("corrupt zip entry b.cpp") << true;
+
+    // Inflates to more, and to less, than the size the headers declare
+    ZipEntry oversized{"b.cpp", content, true};
+    oversized.declaredSize = content.size() - 1;
+    QTest::newRow("more than declared") << QStringLiteral("more.zip") << zipArchive({oversized})
+                                        << QStringLiteral("does not match its declared size") << true;
+    ZipEntry undersized{"b.cpp", content, true};
+    undersized.declaredSize = content.size() + 1;
+    QTest::newRow("less than declared") << QStringLiteral("less.zip") << zipArchive({undersized})
+                                        << QStringLiteral("does not match its declared size") << true;
+
+    const QByteArray tgz = gzip(tar);
+    QTest::newRow("gzip stream") << QStringLiteral("cut.tar.gz") << tgz.left(tgz.size() / 2)
+                                 << QStringLiteral("corrupt gzip data") << true;
+}
+
+void SubmissionCollectorTest::truncated()
+{
+    QFETCH(QString, name);
+    QFETCH(QByteArray, bytes);
+    QFETCH(QString, error);
+    QFETCH(bool, needsZlib);
+
+#ifndef HASHTRACE_HAVE_ZLIB
+    if (needsZlib) {
+        QSKIP("built without zlib");
+    }
+#else
+    Q_UNUSED(needsZlib);
+#endif
+    QVERIFY(!collectArchive(name, bytes));
+    QVERIFY2(m_collector->errorString().contains(error), qPrintable(m_collector->errorString()));
+    QVERIFY(m_collector->files().isEmpty());
+}
+
+QTEST_GUILESS_MAIN(SubmissionCollectorTest)
+#include "SubmissionCollectorTest.moc"